@@ -1,7 +1,8 @@
 #!/bin/bash
-GCC_FLAGS="-lm -g -Wall -Wextra -fsanitize=address,undefined"
+GCC_FLAGS="-g -Wall -Wextra -fsanitize=address,undefined"
+LIBS="-lm -pthread"
 
 rm -f ./build/day*
 for file in *.c; do
-    gcc $GCC_FLAGS "$file" -o "./build/${file%.c}"
+    gcc $GCC_FLAGS "$file" -o "./build/${file%.c}" $LIBS
 done
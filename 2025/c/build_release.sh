@@ -1,7 +1,8 @@
 #!/bin/bash
-GCC_FLAGS="-lm -O3 -march=native -Wall -Wextra "
+GCC_FLAGS="-O3 -march=native -Wall -Wextra "
+LIBS="-lm -pthread"
 
 rm -f ./build/day*
 for file in *.c; do
-    gcc $GCC_FLAGS "$file" -o "./build/${file%.c}"
+    gcc $GCC_FLAGS "$file" -o "./build/${file%.c}" $LIBS
 done
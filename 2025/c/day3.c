@@ -1,12 +1,50 @@
+#include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdint.h>
 #include <inttypes.h>
 #include <ctype.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "common.h"
 
 #define BANK_SIZE 128
 
+typedef struct {
+    const char *begin;   // chunk of the input, starts at the line start
+    const char *end;     // and ends right after '\n' (or at the end of input)
+    uint64_t answer1;
+    uint64_t answer2;
+} BanksChunk;
+
+// max joltage of single bank, using max_battery_cnt batteries
+static uint64_t bank_joltage(const char *bank, size_t bank_len, size_t max_battery_cnt)
+{
+    if (bank_len < max_battery_cnt) {
+        return 0;
+    }
+    uint64_t result_joltage = 0;
+    const char *current_bank_pos = bank;
+
+    for (size_t bat_num = 0; bat_num < max_battery_cnt; ++bat_num) {
+        // find max possible joltage for battery starting from left side (most significant)
+        // until rightmost limit, allowing space for rest of batteries
+        const char *limit = bank + bank_len - (max_battery_cnt - 1) + bat_num;
+        for (char joltage = '9'; joltage > '0'; --joltage) {
+            const char *p = memchr(current_bank_pos, joltage, limit - current_bank_pos);
+            if (p) {
+                result_joltage = result_joltage * 10 + (joltage - '0');
+                current_bank_pos = p + 1;
+                break;
+            }
+        }
+    }
+    return result_joltage;
+}
+
 void calculate(const size_t max_battery_cnt, FILE *f)
 {
     uint64_t answer = 0;
@@ -15,41 +53,116 @@ void calculate(const size_t max_battery_cnt, FILE *f)
     while (fgets(bank, ARRAY_LENGTH(bank), f)) {
         size_t bank_len = 0;
         while(isdigit(bank[bank_len])) ++bank_len; // avoid line ending and other non-digit stuff at the line end
+        answer += bank_joltage(bank, bank_len, max_battery_cnt);
+    }
 
-        char result_str[BANK_SIZE]; 
-        char *current_bank_pos = bank; 
-
-        for (size_t bat_num = 0; bat_num < max_battery_cnt; ++bat_num) {
-            // find max possible joltage for battery starting from left side (most significant) 
-            // until rightmost limit (see below)
-            for(char joltage = '9'; joltage > '0'; --joltage) {
-                char *p = strchr(current_bank_pos, joltage);
-                // check that max possible joltage was found between leftmost possible position (not taken 
-                // by previos batteries) and rightmost possible pos (allowing space for rest of batteries)
-                if(p && p < (bank + bank_len - (max_battery_cnt - 1) + bat_num)) {
-                    result_str[bat_num] = joltage;
-                    current_bank_pos = p + 1;
-                    break;
-                }
-            }
+    printf("answer: %"PRIu64"\n", answer);
+}
+
+// worker: both parts for every bank in the chunk, sums are kept per chunk
+static void *calculate_chunk(void *arg)
+{
+    BanksChunk *chunk = arg;
+    const char *line = chunk->begin;
+
+    while (line < chunk->end) {
+        size_t bank_len = 0;
+        while (line + bank_len < chunk->end && isdigit(line[bank_len])) ++bank_len;
+
+        chunk->answer1 += bank_joltage(line, bank_len, 2);
+        chunk->answer2 += bank_joltage(line, bank_len, 12);
+
+        const char *eol = memchr(line + bank_len, '\n', chunk->end - line - bank_len);
+        line = eol ? eol + 1 : chunk->end;
+    }
+    return NULL;
+}
+
+// split mapped input into newline aligned chunks, one per thread
+static void calculate_parallel(const char *data, size_t size, size_t threads_cnt)
+{
+    BanksChunk *chunks = calloc(threads_cnt, sizeof(BanksChunk));
+    pthread_t *threads = malloc(threads_cnt * sizeof(pthread_t));
+
+    const char *chunk_begin = data;
+    for (size_t t = 0; t < threads_cnt; ++t) {
+        const char *chunk_end = data + size * (t + 1) / threads_cnt;
+        if (chunk_end < chunk_begin) {
+            chunk_end = chunk_begin;
+        }
+        if (t != threads_cnt - 1) {
+            const char *eol = memchr(chunk_end, '\n', data + size - chunk_end);
+            chunk_end = eol ? eol + 1 : data + size;
         }
-        result_str[max_battery_cnt] = '\0';
-        // convert and add
-        uint64_t result_joltage;
-        sscanf(result_str, "%"SCNu64, &result_joltage);
-        answer += result_joltage;
+        chunks[t].begin = chunk_begin;
+        chunks[t].end = chunk_end;
+        chunk_begin = chunk_end;
+        pthread_create(&threads[t], NULL, calculate_chunk, &chunks[t]);
     }
-    
-    printf("answer: %"PRIu64"\n", answer);
+    // combine in chunk order, so result doesn't depend on scheduling
+    uint64_t answer1 = 0, answer2 = 0;
+    for (size_t t = 0; t < threads_cnt; ++t) {
+        pthread_join(threads[t], NULL);
+        answer1 += chunks[t].answer1;
+        answer2 += chunks[t].answer2;
+    }
+
+    printf("part 1");
+    printf("answer: %"PRIu64"\n", answer1);
+    printf("part 2");
+    printf("answer: %"PRIu64"\n", answer2);
+
+    free(threads);
+    free(chunks);
+}
+
+static int run_parallel(const char *file_name, size_t threads_cnt)
+{
+    int fd = open(file_name, O_RDONLY);
+    if (fd < 0) {
+        printf("can't open file %s\n", file_name);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        printf("can't read file %s\n", file_name);
+        close(fd);
+        return -1;
+    }
+    if (st.st_size == 0) {
+        // no banks, and empty file can't be mapped
+        calculate_parallel("", 0, 1);
+        close(fd);
+        return 0;
+    }
+    const char *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        printf("can't map file %s\n", file_name);
+        close(fd);
+        return -1;
+    }
+    madvise((void *)data, st.st_size, MADV_SEQUENTIAL);
+
+    calculate_parallel(data, st.st_size, threads_cnt);
+
+    munmap((void *)data, st.st_size);
+    close(fd);
+    return 0;
 }
 
 int main(int argv, char* argc[])
 {
-    if (argv != 2) {
+    if (argv < 2) {
         printf("no input file specified!\n");
+        printf("usage: %s [parallel] <input> [threads]\n", argc[0]);
         return -1;
     }
 
+    if (argv >= 3 && strcmp(argc[1], "parallel") == 0) {
+        long threads_cnt = argv >= 4 ? atol(argc[3]) : sysconf(_SC_NPROCESSORS_ONLN);
+        return run_parallel(argc[2], threads_cnt > 0 ? threads_cnt : 1);
+    }
+
     FILE *f = fopen(argc[1], "r");
     if (!f) {
         printf("can't open file %s\n", argc[1]);
@@ -3,18 +3,47 @@
 #include <string.h>
 #include <stdbool.h>
 #include <ctype.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "common.h"
 
 typedef struct {
-    unsigned short width;
-    unsigned short height;
+    size_t width;
+    size_t height;
     char *data;
 } RollsMap;
 
+// map packed into bits, one bit per cell, 64 cells per word.
+// each row has one zero word on the left and on the right side,
+// and there is one zero row above and below the map, so neighbours
+// can be read without bounds checks
+typedef struct {
+    size_t width;
+    size_t height;
+    size_t row_words;   // words per row, without padding
+    size_t stride;      // words per row, with padding
+    uint64_t *words;
+} Bitboard;
+
 void load_map(RollsMap *map, FILE* f);
 void print_map(RollsMap *map);
+static void bitboard_init(Bitboard *bb, size_t width, size_t height);
+static void bitboard_from_map(Bitboard *bb, const RollsMap *map);
+static size_t bitboard_pass(const Bitboard *src, Bitboard *dst);
+static int solve_bitboard(RollsMap *map);
+static int solve_incremental(RollsMap *map);
+static int solve_parallel(RollsMap *map, size_t threads_cnt);
+static int solve_stream(FILE *f);
 
-int is_roll(RollsMap *map, int row, int col) {
-    if (row < 0 || col < 0 || row >= map->height || col >= map->width) {
+// row/col of -1 wrap around to SIZE_MAX, and are out of bounds as well
+int is_roll(RollsMap *map, size_t row, size_t col) {
+    if (row >= map->height || col >= map->width) {
         return 0;
     }
     return map->data[row * map->width + col] == '.' ? 0 : 1;
@@ -22,29 +51,58 @@ int is_roll(RollsMap *map, int row, int col) {
 
 int main(int argv, char* argc[])
 {
-    if (argv != 2) {
+    if (argv < 2) {
         printf("no input file specified!\n");
+        printf("usage: %s [bitboard|incremental|parallel|stream] <input> [threads]\n", argc[0]);
+        printf("stream mode reads stdin if input is '-'\n");
         return -1;
     }
 
-    FILE *f = fopen(argc[1], "r");
+    const char *mode = argv >= 3 ? argc[1] : "";
+    const char *file_name = argv >= 3 ? argc[2] : argc[1];
+
+    if (strcmp(mode, "stream") == 0 && strcmp(file_name, "-") == 0) {
+        return solve_stream(stdin);
+    }
+
+    FILE *f = fopen(file_name, "r");
     if (!f) {
-        printf("can't open file %s\n", argc[1]);
+        printf("can't open file %s\n", file_name);
         return -1;
     }
 
+    if (strcmp(mode, "stream") == 0) {
+        int result = solve_stream(f);
+        fclose(f);
+        return result;
+    }
+
     RollsMap map = {0};
     load_map(&map, f);
     // print_map(&map);
 
-    int answer1 = 0, answer2 = 0, rolls_found;
+    if (strcmp(mode, "bitboard") == 0) {
+        fclose(f);
+        return solve_bitboard(&map);
+    }
+    if (strcmp(mode, "incremental") == 0) {
+        fclose(f);
+        return solve_incremental(&map);
+    }
+    if (strcmp(mode, "parallel") == 0) {
+        fclose(f);
+        long threads_cnt = argv >= 4 ? atol(argc[3]) : sysconf(_SC_NPROCESSORS_ONLN);
+        return solve_parallel(&map, threads_cnt > 0 ? threads_cnt : 1);
+    }
+
+    size_t answer1 = 0, answer2 = 0, rolls_found;
     bool first_pass = true;
 
     do {
         rolls_found = 0;
         // search for rolls to remove
-        for (int row = 0; row < map.height; ++row) {
-            for(int col = 0; col < map.width; ++col) {
+        for (size_t row = 0; row < map.height; ++row) {
+            for(size_t col = 0; col < map.width; ++col) {
                 if (!is_roll(&map, row, col)) {
                     continue;
                 }
@@ -66,13 +124,13 @@ int main(int argv, char* argc[])
         answer2 += rolls_found;
         // print_map(&map);
         // remove 'x' rolls from map
-        for(int pos = 0; pos < map.height * map.width; ++pos) {
+        for(size_t pos = 0; pos < map.height * map.width; ++pos) {
             if (map.data[pos] == 'x') map.data[pos] = '.';
         }
     } while (rolls_found);
 
-    printf("answer1: %d\n", answer1);
-    printf("answer2: %d\n", answer2);
+    printf("answer1: %zu\n", answer1);
+    printf("answer2: %zu\n", answer2);
 
     free(map.data);
     fclose(f);
@@ -90,9 +148,9 @@ void load_map(RollsMap *map, FILE* f)
 
     fread(map->data, 1, file_size, f);
     // remove newline, spaces, etc from data, and calculate width and height
-    unsigned short calc_width = 0;
-    int dst = 0;
-    for (int src = 0; src < file_size; ++src) {
+    size_t calc_width = 0;
+    size_t dst = 0;
+    for (size_t src = 0; src < (size_t)file_size; ++src) {
         if (!map->width && isspace(map->data[src])) {
             map->width = calc_width;
         }
@@ -101,7 +159,10 @@ void load_map(RollsMap *map, FILE* f)
             map->data[dst++] = map->data[src];
         }
     }
-    map->height = dst / map->width;
+    if (!map->width) {
+        map->width = calc_width; // single line without line ending
+    }
+    map->height = map->width ? dst / map->width : 0;
 }
 
 void print_map(RollsMap *map) {
@@ -110,3 +171,413 @@ void print_map(RollsMap *map) {
         puts("");
     }
 }
+
+static void bitboard_init(Bitboard *bb, size_t width, size_t height)
+{
+    bb->width = width;
+    bb->height = height;
+    bb->row_words = (width + 63) / 64;
+    bb->stride = bb->row_words + 2;
+    bb->words = calloc((height + 2) * bb->stride, sizeof(uint64_t));
+}
+
+static inline uint64_t *bitboard_row(const Bitboard *bb, size_t row)
+{
+    return bb->words + (row + 1) * bb->stride + 1;
+}
+
+// dst must be zeroed
+static void pack_row(uint64_t *dst, const char *src, size_t width)
+{
+    for (size_t col = 0; col < width; ++col) {
+        dst[col / 64] |= (uint64_t)(src[col] != '.') << (col % 64);
+    }
+}
+
+static void bitboard_pack_rows(Bitboard *bb, const RollsMap *map, size_t row_begin, size_t row_end)
+{
+    for (size_t row = row_begin; row < row_end; ++row) {
+        pack_row(bitboard_row(bb, row), map->data + row * map->width, map->width);
+    }
+}
+
+static void bitboard_from_map(Bitboard *bb, const RollsMap *map)
+{
+    bitboard_init(bb, map->width, map->height);
+    bitboard_pack_rows(bb, map, 0, map->height);
+}
+
+/*
+    bit-sliced "at least 4 of 8 neighbours" test, for 64 cells at once.
+    three full adders and one half adder reduce 8 neighbour bits to one
+    weight-1 bit and four weight-2 carries. weight-1 bit alone can't reach 4,
+    so count >= 4 is the same as "at least two carries are set"
+*/
+#define FULL_ADD(sum, carry, a, b, c)\
+    do {\
+        uint64_t ab_ = (a) ^ (b);\
+        sum = ab_ ^ (c);\
+        carry = ((a) & (b)) | (ab_ & (c));\
+    } while(0)
+
+static inline uint64_t at_least_4(uint64_t n0, uint64_t n1, uint64_t n2, uint64_t n3,
+                                  uint64_t n4, uint64_t n5, uint64_t n6, uint64_t n7)
+{
+    uint64_t s0, s1, c0, c1;
+    FULL_ADD(s0, c0, n0, n1, n2);
+    FULL_ADD(s1, c1, n3, n4, n5);
+    uint64_t s2 = n6 ^ n7;
+    uint64_t c2 = n6 & n7;
+    // weight-1 sum of the last adder is not needed, only its carry
+    uint64_t c3 = (s0 & s1) | ((s0 ^ s1) & s2);
+    return (c0 & c1) | (c2 & c3) | ((c0 | c1) & (c2 | c3));
+}
+
+#ifdef __AVX2__
+static inline __m256i at_least_4_avx2(__m256i n0, __m256i n1, __m256i n2, __m256i n3,
+                                      __m256i n4, __m256i n5, __m256i n6, __m256i n7)
+{
+    __m256i ab, s0, s1, s2, c0, c1, c2, c3;
+    ab = _mm256_xor_si256(n0, n1);
+    s0 = _mm256_xor_si256(ab, n2);
+    c0 = _mm256_or_si256(_mm256_and_si256(n0, n1), _mm256_and_si256(ab, n2));
+    ab = _mm256_xor_si256(n3, n4);
+    s1 = _mm256_xor_si256(ab, n5);
+    c1 = _mm256_or_si256(_mm256_and_si256(n3, n4), _mm256_and_si256(ab, n5));
+    s2 = _mm256_xor_si256(n6, n7);
+    c2 = _mm256_and_si256(n6, n7);
+    ab = _mm256_xor_si256(s0, s1);
+    c3 = _mm256_or_si256(_mm256_and_si256(s0, s1), _mm256_and_si256(ab, s2));
+
+    return _mm256_or_si256(
+        _mm256_or_si256(_mm256_and_si256(c0, c1), _mm256_and_si256(c2, c3)),
+        _mm256_and_si256(_mm256_or_si256(c0, c1), _mm256_or_si256(c2, c3))
+    );
+}
+
+// west neighbours: column c-1 moved to c, carry comes from previous word
+static inline __m256i shift_west_avx2(const uint64_t *p)
+{
+    __m256i cur = _mm256_loadu_si256((const __m256i *)p);
+    __m256i prev = _mm256_loadu_si256((const __m256i *)(p - 1));
+    return _mm256_or_si256(_mm256_slli_epi64(cur, 1), _mm256_srli_epi64(prev, 63));
+}
+
+static inline __m256i shift_east_avx2(const uint64_t *p)
+{
+    __m256i cur = _mm256_loadu_si256((const __m256i *)p);
+    __m256i next = _mm256_loadu_si256((const __m256i *)(p + 1));
+    return _mm256_or_si256(_mm256_srli_epi64(cur, 1), _mm256_slli_epi64(next, 63));
+}
+#endif
+
+/*
+    one removal pass for a single row: rolls with fewer than 4 neighbours
+    are removed, result goes to dst. above/row/below must point to padded rows.
+    returns count of removed rolls
+*/
+static size_t bitboard_row_pass(const uint64_t *above, const uint64_t *row, const uint64_t *below,
+                                uint64_t *dst, size_t words)
+{
+    size_t removed = 0;
+    size_t w = 0;
+#ifdef __AVX2__
+    for (; w + 4 <= words; w += 4) {
+        __m256i cur = _mm256_loadu_si256((const __m256i *)(row + w));
+        __m256i ge4 = at_least_4_avx2(
+            shift_west_avx2(above + w), _mm256_loadu_si256((const __m256i *)(above + w)), shift_east_avx2(above + w),
+            shift_west_avx2(row + w), shift_east_avx2(row + w),
+            shift_west_avx2(below + w), _mm256_loadu_si256((const __m256i *)(below + w)), shift_east_avx2(below + w)
+        );
+        _mm256_storeu_si256((__m256i *)(dst + w), _mm256_and_si256(cur, ge4));
+
+        uint64_t removable[4];
+        _mm256_storeu_si256((__m256i *)removable, _mm256_andnot_si256(ge4, cur));
+        removed += __builtin_popcountll(removable[0]) + __builtin_popcountll(removable[1]) +
+                   __builtin_popcountll(removable[2]) + __builtin_popcountll(removable[3]);
+    }
+#endif
+    for (; w < words; ++w) {
+        uint64_t ge4 = at_least_4(
+            (above[w] << 1) | (above[w - 1] >> 63), above[w], (above[w] >> 1) | (above[w + 1] << 63),
+            (row[w] << 1) | (row[w - 1] >> 63), (row[w] >> 1) | (row[w + 1] << 63),
+            (below[w] << 1) | (below[w - 1] >> 63), below[w], (below[w] >> 1) | (below[w + 1] << 63)
+        );
+        dst[w] = row[w] & ge4;
+        removed += __builtin_popcountll(row[w] & ~ge4);
+    }
+    return removed;
+}
+
+// one removal pass over rows range, src and dst must have the same size
+static size_t bitboard_rows_pass(const Bitboard *src, Bitboard *dst, size_t row_begin, size_t row_end)
+{
+    size_t removed = 0;
+    for (size_t row = row_begin; row < row_end; ++row) {
+        removed += bitboard_row_pass(
+            bitboard_row(src, row) - src->stride, bitboard_row(src, row), bitboard_row(src, row) + src->stride,
+            bitboard_row(dst, row), src->row_words
+        );
+    }
+    return removed;
+}
+
+static size_t bitboard_pass(const Bitboard *src, Bitboard *dst)
+{
+    return bitboard_rows_pass(src, dst, 0, src->height);
+}
+
+static int solve_bitboard(RollsMap *map)
+{
+    Bitboard cur, next;
+    bitboard_from_map(&cur, map);
+    bitboard_init(&next, map->width, map->height);
+    free(map->data);
+
+    size_t answer1 = 0, answer2 = 0, rolls_found;
+    bool first_pass = true;
+    do {
+        rolls_found = bitboard_pass(&cur, &next);
+        if (first_pass) {
+            answer1 = rolls_found;
+            first_pass = false;
+        }
+        answer2 += rolls_found;
+        // swap boards
+        Bitboard tmp = cur;
+        cur = next;
+        next = tmp;
+    } while (rolls_found);
+
+    printf("answer1: %zu\n", answer1);
+    printf("answer2: %zu\n", answer2);
+
+    free(cur.words);
+    free(next.words);
+    return 0;
+}
+
+/*
+    worklist version: neighbour counts are calculated once. removing a roll
+    only decrements counts of its 8 neighbours, and a neighbour which drops
+    from 4 to 3 goes to the queue. queue is processed level by level, each
+    level is exactly one pass of the full scan (it contains all rolls that
+    would be found on that pass), so first level size is answer 1
+*/
+enum { NO_ROLL = 0xFF };
+
+static int solve_incremental(RollsMap *map)
+{
+    // padded by one cell on each side, padding and empty cells are NO_ROLL
+    const size_t stride = map->width + 2;
+    const size_t cells_cnt = stride * (map->height + 2);
+    uint8_t *counts = malloc(cells_cnt);
+    memset(counts, NO_ROLL, cells_cnt);
+
+    size_t rolls_cnt = 0;
+    for (size_t row = 0; row < map->height; ++row) {
+        for (size_t col = 0; col < map->width; ++col) {
+            if (!is_roll(map, row, col)) {
+                continue;
+            }
+            counts[(row + 1) * stride + col + 1] =
+                is_roll(map, row - 1, col - 1) + is_roll(map, row - 1, col) + is_roll(map, row - 1, col + 1) +
+                is_roll(map, row    , col - 1) +               0            + is_roll(map, row    , col + 1) +
+                is_roll(map, row + 1, col - 1) + is_roll(map, row + 1, col) + is_roll(map, row + 1, col + 1);
+            ++rolls_cnt;
+        }
+    }
+    free(map->data);
+
+    // every roll is queued at most once
+    size_t *queue = malloc(MAX(rolls_cnt, 1) * sizeof(size_t));
+    size_t head = 0, tail = 0;
+    for (size_t pos = 0; pos < cells_cnt; ++pos) {
+        if (counts[pos] < 4) {
+            queue[tail++] = pos;
+        }
+    }
+
+    const ptrdiff_t neighbours[8] = {
+        -(ptrdiff_t)stride - 1, -(ptrdiff_t)stride, -(ptrdiff_t)stride + 1,
+        -1, 1,
+        (ptrdiff_t)stride - 1, (ptrdiff_t)stride, (ptrdiff_t)stride + 1,
+    };
+
+    size_t answer1 = tail, answer2 = 0;
+    while (head < tail) {
+        // one pass
+        const size_t pass_end = tail;
+        answer2 += pass_end - head;
+        for (; head < pass_end; ++head) {
+            const size_t pos = queue[head];
+            counts[pos] = NO_ROLL;
+            for (size_t n = 0; n < ARRAY_LENGTH(neighbours); ++n) {
+                uint8_t *c = &counts[pos + neighbours[n]];
+                // removed rolls and empty cells are skipped, rolls already queued are below 4
+                if (*c != NO_ROLL && (*c)-- == 4) {
+                    queue[tail++] = pos + neighbours[n];
+                }
+            }
+        }
+    }
+
+    printf("answer1: %zu\n", answer1);
+    printf("answer2: %zu\n", answer2);
+
+    free(queue);
+    free(counts);
+    return 0;
+}
+
+/*
+    band parallel version of bitboard solver. map is split into horizontal
+    bands, one per thread. each pass reads the current board (own rows plus
+    one halo row from neighbour bands) and writes own rows of the next board,
+    so no cell is written while other thread can read it. barrier at the end
+    of the pass makes next board complete before boards are swapped
+*/
+typedef struct {
+    Bitboard boards[2];
+    const RollsMap *map;
+    size_t threads_cnt;
+    pthread_barrier_t barrier;
+    size_t *removed[2];     // removed count per band, for even and odd passes
+    size_t answer1;
+    size_t answer2;
+} BandsSolver;
+
+typedef struct {
+    BandsSolver *solver;
+    size_t idx;
+    size_t row_begin;
+    size_t row_end;
+} Band;
+
+static void *solve_band(void *arg)
+{
+    Band *band = arg;
+    BandsSolver *solver = band->solver;
+
+    bitboard_pack_rows(&solver->boards[0], solver->map, band->row_begin, band->row_end);
+    pthread_barrier_wait(&solver->barrier);
+
+    for (size_t pass = 0;; ++pass) {
+        const Bitboard *src = &solver->boards[pass % 2];
+        Bitboard *dst = &solver->boards[(pass + 1) % 2];
+
+        // removed counters are double buffered too: counters of this pass are
+        // overwritten two passes later, after every thread went through next barrier
+        solver->removed[pass % 2][band->idx] = bitboard_rows_pass(src, dst, band->row_begin, band->row_end);
+        pthread_barrier_wait(&solver->barrier);
+
+        size_t rolls_found = 0;
+        for (size_t t = 0; t < solver->threads_cnt; ++t) {
+            rolls_found += solver->removed[pass % 2][t];
+        }
+        if (band->idx == 0) {
+            if (pass == 0) {
+                solver->answer1 = rolls_found;
+            }
+            solver->answer2 += rolls_found;
+        }
+        if (!rolls_found) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+static int solve_parallel(RollsMap *map, size_t threads_cnt)
+{
+    threads_cnt = MAX(MIN(threads_cnt, map->height), 1);
+
+    BandsSolver solver = { .map = map, .threads_cnt = threads_cnt };
+    bitboard_init(&solver.boards[0], map->width, map->height);
+    bitboard_init(&solver.boards[1], map->width, map->height);
+    solver.removed[0] = calloc(threads_cnt, sizeof(size_t));
+    solver.removed[1] = calloc(threads_cnt, sizeof(size_t));
+    pthread_barrier_init(&solver.barrier, NULL, threads_cnt);
+
+    Band *bands = malloc(threads_cnt * sizeof(Band));
+    pthread_t *threads = malloc(threads_cnt * sizeof(pthread_t));
+    for (size_t t = 0; t < threads_cnt; ++t) {
+        bands[t] = (Band){
+            .solver = &solver,
+            .idx = t,
+            .row_begin = map->height * t / threads_cnt,
+            .row_end = map->height * (t + 1) / threads_cnt,
+        };
+        pthread_create(&threads[t], NULL, solve_band, &bands[t]);
+    }
+    for (size_t t = 0; t < threads_cnt; ++t) {
+        pthread_join(threads[t], NULL);
+    }
+
+    printf("answer1: %zu\n", solver.answer1);
+    printf("answer2: %zu\n", solver.answer2);
+
+    pthread_barrier_destroy(&solver.barrier);
+    free(threads);
+    free(bands);
+    free(solver.removed[0]);
+    free(solver.removed[1]);
+    free(solver.boards[0].words);
+    free(solver.boards[1].words);
+    free(map->data);
+    return 0;
+}
+
+/*
+    part 1 only, for maps that don't fit in memory: rows are read one by one
+    into a ring of three packed rows, and row is counted as soon as the row
+    below it is read. memory is O(width), input can be a pipe
+*/
+static int solve_stream(FILE *f)
+{
+    char *line = NULL;
+    size_t line_cap = 0;
+    ssize_t line_len;
+
+    size_t width = 0, stride = 0;
+    uint64_t *buf = NULL;         // 3 ring rows, zero row, scratch row
+    uint64_t *ring[3], *zero_row = NULL, *scratch = NULL;
+    size_t rows_read = 0, answer1 = 0;
+
+    while ((line_len = getline(&line, &line_cap, f)) > 0) {
+        while (line_len && isspace(line[line_len - 1])) --line_len;
+        if (!line_len) {
+            break;
+        }
+        if (!rows_read) {
+            width = line_len;
+            stride = (width + 63) / 64 + 2;
+            buf = calloc(5 * stride, sizeof(uint64_t));
+            for (size_t i = 0; i < 3; ++i) {
+                ring[i] = buf + i * stride + 1;
+            }
+            zero_row = buf + 3 * stride + 1;
+            scratch = buf + 4 * stride + 1;
+        }
+
+        uint64_t *row = ring[rows_read % 3];
+        memset(row, 0, (stride - 2) * sizeof(uint64_t));
+        pack_row(row, line, MIN((size_t)line_len, width));
+
+        if (rows_read) {
+            const uint64_t *above = rows_read >= 2 ? ring[(rows_read - 2) % 3] : zero_row;
+            answer1 += bitboard_row_pass(above, ring[(rows_read - 1) % 3], row, scratch, stride - 2);
+        }
+        ++rows_read;
+    }
+    if (rows_read) {
+        const uint64_t *above = rows_read >= 2 ? ring[(rows_read - 2) % 3] : zero_row;
+        answer1 += bitboard_row_pass(above, ring[(rows_read - 1) % 3], zero_row, scratch, stride - 2);
+    }
+
+    printf("answer1: %zu\n", answer1);
+
+    free(buf);
+    free(line);
+    return 0;
+}
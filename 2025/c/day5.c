@@ -1,9 +1,25 @@
+#define _GNU_SOURCE // accept4
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <inttypes.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
 #include "common.h"
 
@@ -14,23 +30,205 @@ typedef struct {
 
 DARRAY_DEFINE_TYPE(Ranges, Range)
 DARRAY_DEFINE_TYPE(IDs, uint64_t)
+DARRAY_DEFINE_TYPE(Bytes, uint8_t)
 
-int main(int argv, char* argc[])
+/*
+    compiled range set file, native byte order:
+    IndexHeader | IndexSample[blocks_count] | delta encoded bounds[data_size]
+    merged ranges are stored in blocks of block_ranges ranges. inside the block
+    each range is two LEB128 varints: min - previous max, and max - min.
+    previous max of the first range in block is the block first_min, so lookup
+    is a binary search over samples and decoding of a single block
+*/
+#define INDEX_MAGIC "AOC5RIDX"
+#define INDEX_VERSION 1
+#define INDEX_BLOCK_RANGES 32
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t block_ranges;
+    uint64_t ranges_count;
+    uint64_t blocks_count;
+    uint64_t covered;       // answer for the second task
+    uint64_t data_size;
+} IndexHeader;
+
+typedef struct {
+    uint64_t first_min;
+    uint64_t offset;        // block offset in delta encoded data
+} IndexSample;
+
+typedef struct {
+    const IndexHeader *header;
+    const IndexSample *samples;
+    const uint8_t *data;
+    size_t file_size;
+} RangeIndex;
+
+static int compare_ranges(const void *a, const void *b)
 {
-    if (argv != 2) {
-        printf("no input file specified!\n");
-        return -1;
+    const Range *r_a = a;
+    const Range *r_b = b;
+    if (r_a->min != r_b->min) return r_a->min < r_b->min ? -1 : 1;
+    if (r_a->max != r_b->max) return r_a->max < r_b->max ? -1 : 1;
+    return 0;
+}
+
+// sort by min and merge overlapping or adjacent ranges in one sweep, inplace
+static void merge_ranges(Ranges *ranges)
+{
+    if (!ranges->length) {
+        return;
     }
+    qsort(ranges->data, ranges->length, sizeof(Range), compare_ranges);
 
-    FILE *f = fopen(argc[1], "r");
-    if (!f) {
-        printf("can't open file %s\n", argc[1]);
-        return -1;
+    size_t merged_len = 0;
+    for (size_t i = 1; i < ranges->length; ++i) {
+        Range *last = &ranges->data[merged_len];
+        Range r = ranges->data[i];
+        // r.min - 1 == last->max is adjacency check, without overflow on UINT64_MAX
+        if (r.min <= last->max || r.min - 1 == last->max) {
+            last->max = MAX(last->max, r.max);
+        } else {
+            ranges->data[++merged_len] = r;
+        }
     }
+    ranges->length = merged_len + 1;
+}
 
-    Ranges ranges = {0};
-    IDs ids = {0};
+/*
+    merged ranges in Eytzinger (BFS) layout, for batched membership checks.
+    descent is keyed by range ends: lower bound of id among ends is the only
+    range that can contain id, then parallel array of starts gives the answer.
+    tree is always full (2^height - 1 nodes) and padded with UINT64_MAX
+    sentinels, so every lookup makes exactly height branchless steps
+*/
+#define EYTZINGER_LANES 16
+
+typedef struct {
+    size_t height;
+    size_t size;
+    bool covers_max;    // some range ends at UINT64_MAX, sentinels must not match it
+    uint64_t *ends;     // 1-based, [0] is unused
+    uint64_t *starts;
+} EytzingerSet;
+
+static size_t eytzinger_fill(EytzingerSet *set, const Ranges *ranges, size_t sorted_idx, size_t k)
+{
+    if (k <= set->size) {
+        sorted_idx = eytzinger_fill(set, ranges, sorted_idx, 2 * k);
+        bool real = sorted_idx < ranges->length;
+        set->ends[k] = real ? ranges->data[sorted_idx].max : UINT64_MAX;
+        set->starts[k] = real ? ranges->data[sorted_idx].min : UINT64_MAX;
+        sorted_idx = eytzinger_fill(set, ranges, sorted_idx + 1, 2 * k + 1);
+    }
+    return sorted_idx;
+}
+
+// ranges must be merged
+static void eytzinger_build(EytzingerSet *set, const Ranges *ranges)
+{
+    // at least one sentinel, so lower bound always exists
+    set->height = 1;
+    while (((size_t)1 << set->height) - 1 < ranges->length + 1) {
+        ++set->height;
+    }
+    set->size = ((size_t)1 << set->height) - 1;
+    set->covers_max = ranges->length && ranges->data[ranges->length - 1].max == UINT64_MAX;
+
+    // cache line aligned, so 8 descendants 3 levels down share one line
+    size_t bytes = ((set->size + 1) * sizeof(uint64_t) + 63) / 64 * 64;
+    set->ends = aligned_alloc(64, bytes);
+    set->starts = aligned_alloc(64, bytes);
+    set->ends[0] = set->starts[0] = 0;
+    eytzinger_fill(set, ranges, 0, 1);
+}
+
+static void eytzinger_free(EytzingerSet *set)
+{
+    free(set->ends);
+    free(set->starts);
+}
+
+static inline size_t eytzinger_lower_bound(const EytzingerSet *set, uint64_t id)
+{
+    size_t k = 1;
+    for (size_t level = 0; level < set->height; ++level) {
+        k = 2 * k + (set->ends[k] < id);
+    }
+    // drop trailing right turns and the last left turn
+    return k >> __builtin_ffsll(~k);
+}
+
+static bool eytzinger_is_fresh(const EytzingerSet *set, uint64_t id)
+{
+    size_t k = eytzinger_lower_bound(set, id);
+    return (set->starts[k] <= id) & ((id != UINT64_MAX) | set->covers_max);
+}
+
+// count fresh ids, and set per id flags if flags is not NULL. ids are processed in groups
+// of EYTZINGER_LANES interleaved descents, so memory latency of one lane is hidden behind the others
+static uint64_t eytzinger_count_fresh(const EytzingerSet *set, const uint64_t *ids, size_t ids_cnt, uint8_t *flags)
+{
+    uint64_t fresh = 0;
+    size_t i = 0;
+    for (; i + EYTZINGER_LANES <= ids_cnt; i += EYTZINGER_LANES) {
+        const uint64_t *lane_ids = ids + i;
+        size_t k[EYTZINGER_LANES];
+        for (size_t l = 0; l < EYTZINGER_LANES; ++l) {
+            k[l] = 1;
+        }
+        for (size_t level = 0; level < set->height; ++level) {
+            for (size_t l = 0; l < EYTZINGER_LANES; ++l) {
+                __builtin_prefetch(set->ends + k[l] * 8);
+                k[l] = 2 * k[l] + (set->ends[k[l]] < lane_ids[l]);
+            }
+        }
+        for (size_t l = 0; l < EYTZINGER_LANES; ++l) {
+            k[l] >>= __builtin_ffsll(~k[l]);
+        }
+#ifdef __AVX2__
+        // unsigned start <= id is !(start > id), signed compare after sign flip
+        const __m256i sign = _mm256_set1_epi64x(INT64_MIN);
+        const __m256i all_ones = _mm256_set1_epi64x(-1);
+        const __m256i max_id_mask = set->covers_max ? _mm256_setzero_si256() : all_ones;
+        for (size_t l = 0; l < EYTZINGER_LANES; l += 4) {
+            __m256i idx = _mm256_loadu_si256((const __m256i *)&k[l]);
+            __m256i starts = _mm256_i64gather_epi64((const long long *)set->starts, idx, 8);
+            __m256i id = _mm256_loadu_si256((const __m256i *)&lane_ids[l]);
+            __m256i outside = _mm256_cmpgt_epi64(_mm256_xor_si256(starts, sign), _mm256_xor_si256(id, sign));
+            outside = _mm256_or_si256(outside, _mm256_and_si256(_mm256_cmpeq_epi64(id, all_ones), max_id_mask));
+            int outside_mask = _mm256_movemask_pd(_mm256_castsi256_pd(outside));
+            fresh += 4 - __builtin_popcount(outside_mask);
+            if (flags) {
+                for (size_t j = 0; j < 4; ++j) {
+                    flags[i + l + j] = !((outside_mask >> j) & 1);
+                }
+            }
+        }
+#else
+        for (size_t l = 0; l < EYTZINGER_LANES; ++l) {
+            bool is_fresh = (set->starts[k[l]] <= lane_ids[l]) & ((lane_ids[l] != UINT64_MAX) | set->covers_max);
+            fresh += is_fresh;
+            if (flags) {
+                flags[i + l] = is_fresh;
+            }
+        }
+#endif
+    }
+    for (; i < ids_cnt; ++i) {
+        bool is_fresh = eytzinger_is_fresh(set, ids[i]);
+        fresh += is_fresh;
+        if (flags) {
+            flags[i] = is_fresh;
+        }
+    }
+    return fresh;
+}
 
+static void read_ranges(Ranges *ranges, FILE *f)
+{
     char tmp_str[128];
     // load ranges till empty line
     while (fgets(tmp_str, ARRAY_LENGTH(tmp_str), f)) {
@@ -39,53 +237,1051 @@ int main(int argv, char* argc[])
             break;
         }
         Range r = { .min = min, .max = max };
-        DARRAY_PUSH(ranges, r);
+        DARRAY_PUSH(*ranges, r);
+    }
+}
+
+typedef enum {
+    ID_LINE_ID,
+    ID_LINE_SKIP,           // empty line or range
+    ID_LINE_BAD,
+} IdLine;
+
+static bool parse_u64(const char **p, uint64_t *value)
+{
+    if (!isdigit((unsigned char)**p)) {
+        return false; // strtoull would take sign and spaces
+    }
+    char *end;
+    errno = 0;
+    *value = strtoull(*p, &end, 10);
+    *p = end;
+    return errno != ERANGE;
+}
+
+/*
+    whole line must be one id, "3-5" is a range and not id 3. ranges and
+    empty lines are skipped, so ids can be taken from the whole puzzle input
+*/
+static IdLine parse_id_line(const char *line, uint64_t *id)
+{
+    const char *p = line;
+    while (isspace((unsigned char)*p)) ++p;
+    if (!*p) {
+        return ID_LINE_SKIP;
+    }
+    if (!parse_u64(&p, id)) {
+        return ID_LINE_BAD;
+    }
+    bool range = *p == '-';
+    if (range) {
+        uint64_t max;
+        ++p;
+        if (!parse_u64(&p, &max)) {
+            return ID_LINE_BAD;
+        }
+    }
+    while (isspace((unsigned char)*p)) ++p;
+    if (*p) {
+        return ID_LINE_BAD;
     }
+    return range ? ID_LINE_SKIP : ID_LINE_ID;
+}
+
+static void print_bad_id(const char *line)
+{
+    printf("bad id: %s%s", line, strchr(line, '\n') ? "" : "\n");
+}
+
+static void read_ids(IDs *ids, FILE *f)
+{
+    char tmp_str[128];
     // load ids till end of file
     while (fgets(tmp_str, ARRAY_LENGTH(tmp_str), f)) {
         uint64_t id;
-        if (sscanf(tmp_str, "%"SCNu64, &id) != 1) {
+        switch (parse_id_line(tmp_str, &id)) {
+        case ID_LINE_ID:
+            DARRAY_PUSH(*ids, id);
+            break;
+        case ID_LINE_SKIP:
+            break;
+        case ID_LINE_BAD:
+            print_bad_id(tmp_str);
+            break;
+        }
+    }
+}
+
+// ranges must be merged
+static uint64_t covered_total(const Ranges *ranges)
+{
+    uint64_t total = 0;
+    for (size_t ranges_idx = 0; ranges_idx < ranges->length; ++ranges_idx) {
+        total += ranges->data[ranges_idx].max - ranges->data[ranges_idx].min + 1;
+    }
+    return total;
+}
+
+static void varint_push(Bytes *bytes, uint64_t v)
+{
+    while (v >= 0x80) {
+        DARRAY_PUSH(*bytes, (uint8_t)(v | 0x80));
+        v >>= 7;
+    }
+    DARRAY_PUSH(*bytes, (uint8_t)v);
+}
+
+// returns NULL if varint is truncated
+static const uint8_t *varint_read(const uint8_t *p, const uint8_t *end, uint64_t *v)
+{
+    *v = 0;
+    for (unsigned shift = 0; p < end && shift < 64; shift += 7) {
+        uint8_t b = *p++;
+        *v |= (uint64_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+static int compile_index(const char *input_name, const char *index_name)
+{
+    FILE *f = fopen(input_name, "r");
+    if (!f) {
+        printf("can't open file %s\n", input_name);
+        return -1;
+    }
+    Ranges ranges = {0};
+    read_ranges(&ranges, f);
+    fclose(f);
+    merge_ranges(&ranges);
+
+    IndexHeader header = {
+        .version = INDEX_VERSION,
+        .block_ranges = INDEX_BLOCK_RANGES,
+        .ranges_count = ranges.length,
+        .blocks_count = (ranges.length + INDEX_BLOCK_RANGES - 1) / INDEX_BLOCK_RANGES,
+        .covered = covered_total(&ranges),
+    };
+    memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+
+    IndexSample *samples = malloc(MAX(header.blocks_count, 1) * sizeof(IndexSample));
+    Bytes data = {0};
+    uint64_t prev_max = 0;
+    for (size_t i = 0; i < ranges.length; ++i) {
+        if (i % INDEX_BLOCK_RANGES == 0) {
+            samples[i / INDEX_BLOCK_RANGES] = (IndexSample){ .first_min = ranges.data[i].min, .offset = data.length };
+            prev_max = ranges.data[i].min;
+        }
+        varint_push(&data, ranges.data[i].min - prev_max);
+        varint_push(&data, ranges.data[i].max - ranges.data[i].min);
+        prev_max = ranges.data[i].max;
+    }
+    header.data_size = data.length;
+
+    int result = 0;
+    FILE *out = fopen(index_name, "wb");
+    if (!out) {
+        printf("can't create file %s\n", index_name);
+        result = -1;
+    } else {
+        bool written =
+            fwrite(&header, sizeof(header), 1, out) == 1 &&
+            fwrite(samples, sizeof(IndexSample), header.blocks_count, out) == header.blocks_count &&
+            fwrite(data.data, 1, data.length, out) == data.length;
+        if (fclose(out) != 0 || !written) {
+            printf("can't write file %s\n", index_name);
+            result = -1;
+        } else {
+            printf("%zu ranges, %"PRIu64" blocks, %zu bytes of bounds\n", ranges.length, header.blocks_count, data.length);
+        }
+    }
+
+    free(data.data);
+    free(samples);
+    free(ranges.data);
+    return result;
+}
+
+static bool open_index(RangeIndex *index, const char *index_name)
+{
+    int fd = open(index_name, O_RDONLY);
+    if (fd < 0) {
+        printf("can't open file %s\n", index_name);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(IndexHeader)) {
+        printf("%s is not a range index\n", index_name);
+        close(fd);
+        return false;
+    }
+    void *mem = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED) {
+        printf("can't map file %s\n", index_name);
+        return false;
+    }
+
+    index->file_size = st.st_size;
+    index->header = mem;
+    index->samples = (const IndexSample *)(index->header + 1);
+    index->data = (const uint8_t *)(index->samples + index->header->blocks_count);
+
+    const IndexHeader *h = index->header;
+    bool valid =
+        memcmp(h->magic, INDEX_MAGIC, sizeof(h->magic)) == 0 &&
+        h->version == INDEX_VERSION &&
+        h->block_ranges != 0 &&
+        h->blocks_count == (h->ranges_count + h->block_ranges - 1) / h->block_ranges &&
+        h->blocks_count <= (index->file_size - sizeof(IndexHeader)) / sizeof(IndexSample) &&
+        h->data_size == index->file_size - sizeof(IndexHeader) - h->blocks_count * sizeof(IndexSample);
+    if (!valid) {
+        printf("%s is not a range index\n", index_name);
+        munmap(mem, st.st_size);
+        return false;
+    }
+    return true;
+}
+
+static bool index_is_fresh(const RangeIndex *index, uint64_t id)
+{
+    const IndexHeader *h = index->header;
+    // last block with first_min <= id
+    size_t lo = 0, hi = h->blocks_count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (index->samples[mid].first_min <= id) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (!lo) {
+        return false;
+    }
+    const size_t block = lo - 1;
+    const uint8_t *end = index->data + h->data_size;
+    const uint8_t *p = index->data + MIN(index->samples[block].offset, h->data_size);
+    const size_t block_len = MIN(h->block_ranges, h->ranges_count - block * h->block_ranges);
+
+    uint64_t prev_max = index->samples[block].first_min;
+    for (size_t i = 0; i < block_len; ++i) {
+        uint64_t delta, len;
+        if (!(p = varint_read(p, end, &delta)) || !(p = varint_read(p, end, &len))) {
+            return false;
+        }
+        uint64_t min = prev_max + delta;
+        if (id < min) {
+            return false;
+        }
+        if (id - min <= len) {
+            return true;
+        }
+        prev_max = min + len;
+    }
+    return false;
+}
+
+/*
+    dynamic set of disjoint ranges, for ranges that are added and removed
+    over time. treap keyed by range min, insert merges overlapping and
+    adjacent ranges, remove splits them. covered length is updated on
+    every change, so answer 2 is always available
+*/
+typedef struct RangeNode {
+    Range range;
+    uint64_t priority;
+    struct RangeNode *left;
+    struct RangeNode *right;
+} RangeNode;
+
+typedef struct {
+    RangeNode *root;
+    size_t count;
+    uint64_t covered;
+    uint64_t rng_state;
+} RangeSet;
+
+static RangeNode *rangeset_new_node(RangeSet *set, Range r)
+{
+    // xorshift64
+    set->rng_state ^= set->rng_state << 13;
+    set->rng_state ^= set->rng_state >> 7;
+    set->rng_state ^= set->rng_state << 17;
+
+    RangeNode *node = malloc(sizeof(RangeNode));
+    *node = (RangeNode){ .range = r, .priority = set->rng_state };
+    ++set->count;
+    set->covered += r.max - r.min + 1;
+    return node;
+}
+
+// frees the whole subtree, removing its ranges from set totals
+static void rangeset_drop(RangeSet *set, RangeNode *node)
+{
+    if (!node) {
+        return;
+    }
+    rangeset_drop(set, node->left);
+    rangeset_drop(set, node->right);
+    --set->count;
+    set->covered -= node->range.max - node->range.min + 1;
+    free(node);
+}
+
+// left gets nodes with min < key, right the rest
+static void rangeset_split(RangeNode *node, uint64_t key, RangeNode **left, RangeNode **right)
+{
+    if (!node) {
+        *left = *right = NULL;
+    } else if (node->range.min < key) {
+        rangeset_split(node->right, key, &node->right, right);
+        *left = node;
+    } else {
+        rangeset_split(node->left, key, left, &node->left);
+        *right = node;
+    }
+}
+
+// all mins in left must be less than mins in right
+static RangeNode *rangeset_merge(RangeNode *left, RangeNode *right)
+{
+    if (!left || !right) {
+        return left ? left : right;
+    }
+    if (left->priority > right->priority) {
+        left->right = rangeset_merge(left->right, right);
+        return left;
+    }
+    right->left = rangeset_merge(left, right->left);
+    return right;
+}
+
+static RangeNode *rangeset_rightmost(RangeNode *node)
+{
+    while (node && node->right) {
+        node = node->right;
+    }
+    return node;
+}
+
+static void rangeset_insert(RangeSet *set, Range r)
+{
+    RangeNode *left, *mid, *right;
+    rangeset_split(set->root, r.min, &left, &right);
+
+    // predecessor overlapping or adjacent to the new range (r.min > pred min, so no underflow)
+    RangeNode *pred = rangeset_rightmost(left);
+    if (pred && pred->range.max >= r.min - 1) {
+        r.min = pred->range.min;
+        r.max = MAX(r.max, pred->range.max);
+        rangeset_split(left, pred->range.min, &left, &mid);
+        rangeset_drop(set, mid);
+    }
+    // successors with min <= r.max + 1 are swallowed
+    if (r.max >= UINT64_MAX - 1) {
+        mid = right;
+        right = NULL;
+    } else {
+        rangeset_split(right, r.max + 2, &mid, &right);
+    }
+    RangeNode *last = rangeset_rightmost(mid);
+    if (last) {
+        r.max = MAX(r.max, last->range.max);
+    }
+    rangeset_drop(set, mid);
+
+    set->root = rangeset_merge(rangeset_merge(left, rangeset_new_node(set, r)), right);
+}
+
+static void rangeset_remove(RangeSet *set, Range r)
+{
+    RangeNode *left, *mid, *right, *tail = NULL;
+    rangeset_split(set->root, r.min, &left, &right);
+
+    // predecessor can cover start of the removed range, or even all of it
+    RangeNode *pred = rangeset_rightmost(left);
+    if (pred && pred->range.max >= r.min) {
+        if (pred->range.max > r.max) {
+            tail = rangeset_new_node(set, (Range){ .min = r.max + 1, .max = pred->range.max });
+        }
+        set->covered -= pred->range.max - r.min + 1;
+        pred->range.max = r.min - 1;
+    }
+    // ranges starting inside removed range, the last one can stick out of it
+    if (r.max == UINT64_MAX) {
+        mid = right;
+        right = NULL;
+    } else {
+        rangeset_split(right, r.max + 1, &mid, &right);
+    }
+    RangeNode *last = rangeset_rightmost(mid);
+    if (last && last->range.max > r.max) {
+        tail = rangeset_new_node(set, (Range){ .min = r.max + 1, .max = last->range.max });
+    }
+    rangeset_drop(set, mid);
+
+    set->root = rangeset_merge(left, rangeset_merge(tail, right));
+}
+
+static bool rangeset_contains(const RangeSet *set, uint64_t id)
+{
+    // last range with min <= id
+    const RangeNode *node = set->root, *found = NULL;
+    while (node) {
+        if (node->range.min <= id) {
+            found = node;
+            node = node->right;
+        } else {
+            node = node->left;
+        }
+    }
+    return found && id <= found->range.max;
+}
+
+/*
+    commands, one per line:
+        add <min>-<max>     insert range
+        del <min>-<max>     remove range
+        has <id>            prints 1 if id is fresh, 0 otherwise
+        total               prints covered length (answer 2)
+        count               prints count of disjoint ranges
+*/
+static int run_dynamic(const char *input_name)
+{
+    RangeSet set = { .rng_state = 0x9E3779B97F4A7C15ull };
+
+    if (strcmp(input_name, "-") != 0) {
+        FILE *f = fopen(input_name, "r");
+        if (!f) {
+            printf("can't open file %s\n", input_name);
+            return -1;
+        }
+        Ranges ranges = {0};
+        read_ranges(&ranges, f);
+        fclose(f);
+        for (size_t i = 0; i < ranges.length; ++i) {
+            rangeset_insert(&set, ranges.data[i]);
+        }
+        free(ranges.data);
+    }
+
+    char cmd_buf[128];
+    while (fgets(cmd_buf, ARRAY_LENGTH(cmd_buf), stdin)) {
+        char cmd[8];
+        uint64_t a, b;
+        int fields = sscanf(cmd_buf, "%7s %"SCNu64"-%"SCNu64, cmd, &a, &b);
+        if (fields <= 0) {
+            continue;
+        }
+        if (fields == 3 && strcmp(cmd, "add") == 0 && a <= b) {
+            rangeset_insert(&set, (Range){ .min = a, .max = b });
+        } else if (fields == 3 && strcmp(cmd, "del") == 0 && a <= b) {
+            rangeset_remove(&set, (Range){ .min = a, .max = b });
+        } else if (fields >= 2 && strcmp(cmd, "has") == 0) {
+            printf("%d\n", rangeset_contains(&set, a));
+        } else if (strcmp(cmd, "total") == 0) {
+            printf("%"PRIu64"\n", set.covered);
+        } else if (strcmp(cmd, "count") == 0) {
+            printf("%zu\n", set.count);
+        } else {
+            printf("bad command: %s", cmd_buf);
+        }
+    }
+
+    rangeset_drop(&set, set.root);
+    return 0;
+}
+
+/*
+    query server. ranges are loaded and merged once, then requests are served
+    over unix domain socket. every message is FrameHeader followed by length
+    bytes of payload, native byte order (both sides are on the same machine):
+        OP_QUERY     request: uint64 ids[]
+                     response: uint64 fresh count, uint8 flags[] (1 - fresh)
+        OP_COVERAGE  request: empty
+                     response: uint64 covered length (answer 2), uint64 ranges count
+    response has the same op as request. malformed request closes connection.
+    connection is not read while its pending output is over the limit, and
+    input buffer holds at most one largest request
+*/
+#define SERVER_MAX_EVENTS 64
+#define SERVER_MAX_PAYLOAD (8u << 20)
+#define SERVER_MAX_INPUT (sizeof(FrameHeader) + SERVER_MAX_PAYLOAD)
+#define SERVER_MAX_PENDING_OUTPUT (4u << 20)
+#define CLIENT_BATCH_IDS 4096
+
+enum {
+    OP_QUERY = 1,
+    OP_COVERAGE = 2,
+};
+
+typedef struct {
+    uint32_t length;
+    uint32_t op;
+} FrameHeader;
+
+typedef struct {
+    int fd;
+    Bytes in;
+    Bytes out;
+    size_t out_pos;
+    bool read_closed;       // peer is done sending, close after output is flushed
+    uint32_t events;        // epoll events the connection is registered for
+} Connection;
+
+static volatile sig_atomic_t server_stop = 0;
+
+static void server_on_signal(int sig)
+{
+    (void)sig;
+    server_stop = 1;
+}
+
+static void bytes_append(Bytes *bytes, const void *data, size_t len)
+{
+    size_t old_len = bytes->length;
+    DARRAY_RESIZE(*bytes, old_len + len);
+    memcpy(bytes->data + old_len, data, len);
+}
+
+// handles all complete requests in the input buffer, returns false on protocol error
+static bool connection_process(Connection *conn, const EytzingerSet *set, uint64_t covered, size_t ranges_cnt)
+{
+    size_t pos = 0;
+    while (conn->in.length - pos >= sizeof(FrameHeader)) {
+        FrameHeader req;
+        memcpy(&req, conn->in.data + pos, sizeof(req));
+        if (req.length > SERVER_MAX_PAYLOAD) {
+            return false;
+        }
+        if (conn->in.length - pos - sizeof(FrameHeader) < req.length) {
+            break;
+        }
+        const uint8_t *payload = conn->in.data + pos + sizeof(FrameHeader);
+
+        if (req.op == OP_QUERY && req.length % sizeof(uint64_t) == 0) {
+            size_t ids_cnt = req.length / sizeof(uint64_t);
+            FrameHeader resp = { .length = sizeof(uint64_t) + ids_cnt, .op = OP_QUERY };
+            size_t resp_pos = conn->out.length;
+            DARRAY_RESIZE(conn->out, resp_pos + sizeof(resp) + resp.length);
+            uint8_t *out = conn->out.data + resp_pos;
+
+            // payload is not aligned in the buffer
+            uint64_t ids[CLIENT_BATCH_IDS];
+            uint64_t fresh = 0;
+            for (size_t done = 0; done < ids_cnt; done += CLIENT_BATCH_IDS) {
+                size_t cnt = MIN(ids_cnt - done, (size_t)CLIENT_BATCH_IDS);
+                memcpy(ids, payload + done * sizeof(uint64_t), cnt * sizeof(uint64_t));
+                fresh += eytzinger_count_fresh(set, ids, cnt, out + sizeof(resp) + sizeof(uint64_t) + done);
+            }
+            memcpy(out, &resp, sizeof(resp));
+            memcpy(out + sizeof(resp), &fresh, sizeof(fresh));
+        } else if (req.op == OP_COVERAGE && req.length == 0) {
+            FrameHeader resp = { .length = 2 * sizeof(uint64_t), .op = OP_COVERAGE };
+            uint64_t body[2] = { covered, ranges_cnt };
+            bytes_append(&conn->out, &resp, sizeof(resp));
+            bytes_append(&conn->out, body, sizeof(body));
+        } else {
+            return false;
+        }
+        pos += sizeof(FrameHeader) + req.length;
+    }
+    // keep incomplete request for the next read
+    memmove(conn->in.data, conn->in.data + pos, conn->in.length - pos);
+    conn->in.length -= pos;
+    return true;
+}
+
+// returns false if connection is broken
+static bool connection_flush(Connection *conn)
+{
+    while (conn->out_pos < conn->out.length) {
+        ssize_t sent = send(conn->fd, conn->out.data + conn->out_pos, conn->out.length - conn->out_pos, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return true;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        conn->out_pos += sent;
+    }
+    conn->out.length = conn->out_pos = 0;
+    return true;
+}
+
+static size_t connection_pending(const Connection *conn)
+{
+    return conn->out.length - conn->out_pos;
+}
+
+// reads until the socket is drained or input buffer is full, returns false on error
+static bool connection_read(Connection *conn)
+{
+    while (conn->in.length < SERVER_MAX_INPUT) {
+        if (conn->in.capacity - conn->in.length < 4096 && conn->in.capacity < SERVER_MAX_INPUT) {
+            size_t len = conn->in.length;
+            DARRAY_RESIZE(conn->in, MIN(MAX(conn->in.capacity * 2, (size_t)65536), SERVER_MAX_INPUT));
+            conn->in.length = len;
+        }
+        size_t room = MIN(conn->in.capacity, SERVER_MAX_INPUT) - conn->in.length;
+        ssize_t received = recv(conn->fd, conn->in.data + conn->in.length, room, 0);
+        if (received > 0) {
+            conn->in.length += received;
+        } else if (received == 0) {
+            conn->read_closed = true;
+            return true;
+        } else if (errno == EINTR) {
+            continue;
+        } else {
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+    }
+    return true;
+}
+
+static void connection_close(Connection *conn)
+{
+    close(conn->fd);
+    free(conn->in.data);
+    free(conn->out.data);
+    free(conn);
+}
+
+static int run_server(const char *input_name, const char *socket_path)
+{
+    FILE *f = fopen(input_name, "r");
+    if (!f) {
+        printf("can't open file %s\n", input_name);
+        return -1;
+    }
+    Ranges ranges = {0};
+    read_ranges(&ranges, f);
+    fclose(f);
+    merge_ranges(&ranges);
+
+    EytzingerSet set;
+    eytzinger_build(&set, &ranges);
+    const uint64_t covered = covered_total(&ranges);
+    const size_t ranges_cnt = ranges.length;
+    free(ranges.data);
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        printf("socket path is too long: %s\n", socket_path);
+        eytzinger_free(&set);
+        return -1;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    unlink(socket_path);
+    if (listen_fd < 0 || bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(listen_fd, SOMAXCONN) != 0) {
+        printf("can't listen on %s: %s\n", socket_path, strerror(errno));
+        if (listen_fd >= 0) close(listen_fd);
+        eytzinger_free(&set);
+        return -1;
+    }
+
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL }; // NULL marks listening socket
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev);
+
+    struct sigaction sa = { .sa_handler = server_on_signal };
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    printf("serving %zu ranges on %s\n", ranges_cnt, socket_path);
+    fflush(stdout);
+
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    while (!server_stop) {
+        int events_cnt = epoll_wait(epoll_fd, events, SERVER_MAX_EVENTS, -1);
+        if (events_cnt < 0) {
+            if (errno == EINTR) continue;
             break;
         }
-        DARRAY_PUSH(ids, id);
-    }
-
-    // merge ranges inplace, naively. second option can be sort and merge in one pass,
-    // but this is shorter and i'm not sure that sort version will be faster on small dataset
-    for(bool merged = true; merged;) {
-        merged = false;
-        for (size_t first_range_idx = 0; first_range_idx < ranges.length-1; ++first_range_idx) {
-            for (size_t second_range_idx = first_range_idx + 1; second_range_idx < ranges.length; ++second_range_idx) {
-                Range first_range = ranges.data[first_range_idx];
-                Range second_range = ranges.data[second_range_idx];
-
-                if (second_range.min <= first_range.max && second_range.max >= first_range.min) {
-                    Range merged_range = {
-                        .min = first_range.min < second_range.min ? first_range.min : second_range.min,
-                        .max = first_range.max > second_range.max ? first_range.max : second_range.max,
-                    };
-                    ranges.data[first_range_idx] = merged_range;
-                    DARRAY_REMOVE(ranges, second_range_idx);
-                    merged = true;
+        for (int e = 0; e < events_cnt; ++e) {
+            Connection *conn = events[e].data.ptr;
+            if (!conn) {
+                // accept all pending clients
+                int client_fd;
+                while ((client_fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+                    conn = calloc(1, sizeof(Connection));
+                    conn->fd = client_fd;
+                    conn->events = EPOLLIN | EPOLLRDHUP;
+                    struct epoll_event client_ev = { .events = conn->events, .data.ptr = conn };
+                    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_fd, &client_ev);
+                }
+                continue;
+            }
+
+            bool alive = !(events[e].events & EPOLLERR);
+            // a full input buffer is left for the next wakeup, level triggered
+            // epoll reports the rest of the data again
+            bool can_read = !conn->read_closed && connection_pending(conn) < SERVER_MAX_PENDING_OUTPUT;
+            if (alive && can_read && (events[e].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP))) {
+                alive = connection_read(conn);
+                // requests received before EOF are still answered
+                if (!connection_process(conn, &set, covered, ranges_cnt)) {
+                    alive = false;
                 }
             }
+            if (alive && !connection_flush(conn)) {
+                alive = false;
+            }
+            // after half-close the connection lives until its output is sent
+            bool want_read = !conn->read_closed && connection_pending(conn) < SERVER_MAX_PENDING_OUTPUT;
+            bool want_write = connection_pending(conn) > 0;
+            if (!alive || (!want_read && !want_write)) {
+                epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+                connection_close(conn);
+                continue;
+            }
+            // wait for readable socket only below the output limit,
+            // and for writable socket only while there is pending output
+            uint32_t want_events = (want_read ? EPOLLIN | EPOLLRDHUP : 0) | (want_write ? EPOLLOUT : 0);
+            if (want_events != conn->events) {
+                struct epoll_event client_ev = { .events = want_events, .data.ptr = conn };
+                epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn->fd, &client_ev);
+                conn->events = want_events;
+            }
         }
-    };
-    // count valid ids for the first task. again sorted ids and binary search should be faster, overkill for this task
+    }
+
+    // connections still open at shutdown are leaked to the OS
+    close(epoll_fd);
+    close(listen_fd);
+    unlink(socket_path);
+    eytzinger_free(&set);
+    return 0;
+}
+
+static int client_connect(const char *socket_path)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        return -1;
+    }
+    strcpy(addr.sun_path, socket_path);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd >= 0 && connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static bool write_all(int fd, const void *data, size_t len)
+{
+    const uint8_t *p = data;
+    while (len) {
+        ssize_t sent = send(fd, p, len, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent <= 0) return false;
+        p += sent;
+        len -= sent;
+    }
+    return true;
+}
+
+static bool read_all(int fd, void *data, size_t len)
+{
+    uint8_t *p = data;
+    while (len) {
+        ssize_t received = recv(fd, p, len, 0);
+        if (received < 0 && errno == EINTR) continue;
+        if (received <= 0) return false;
+        p += received;
+        len -= received;
+    }
+    return true;
+}
+
+// one request/response round trip. response payload must fit in resp_size
+static bool client_request(int fd, uint32_t op, const void *payload, uint32_t length, void *resp, size_t resp_size)
+{
+    FrameHeader req = { .length = length, .op = op }, hdr;
+    return write_all(fd, &req, sizeof(req)) &&
+           write_all(fd, payload, length) &&
+           read_all(fd, &hdr, sizeof(hdr)) &&
+           hdr.op == op && hdr.length == resp_size &&
+           read_all(fd, resp, resp_size);
+}
+
+static bool client_query(int fd, const uint64_t *ids, size_t ids_cnt, uint64_t *fresh, uint8_t *resp_buf)
+{
+    if (!client_request(fd, OP_QUERY, ids, ids_cnt * sizeof(uint64_t), resp_buf, sizeof(uint64_t) + ids_cnt)) {
+        return false;
+    }
+    memcpy(fresh, resp_buf, sizeof(uint64_t));
+    return true;
+}
+
+// test client: sends ids in batches, prints answers the same way as the solver
+static int run_client(const char *socket_path, const char *ids_name)
+{
+    int fd = client_connect(socket_path);
+    if (fd < 0) {
+        printf("can't connect to %s\n", socket_path);
+        return -1;
+    }
+    FILE *f = strcmp(ids_name, "-") == 0 ? stdin : fopen(ids_name, "r");
+    if (!f) {
+        printf("can't open file %s\n", ids_name);
+        close(fd);
+        return -1;
+    }
+
+    IDs ids = {0};
+    read_ids(&ids, f);
+    if (f != stdin) {
+        fclose(f);
+    }
+
+    static uint8_t resp_buf[sizeof(uint64_t) + CLIENT_BATCH_IDS];
+    uint64_t answer1 = 0, coverage[2] = {0};
+    bool ok = true;
+    for (size_t done = 0; done < ids.length && ok; done += CLIENT_BATCH_IDS) {
+        uint64_t fresh = 0;
+        ok = client_query(fd, ids.data + done, MIN(ids.length - done, (size_t)CLIENT_BATCH_IDS), &fresh, resp_buf);
+        answer1 += fresh;
+    }
+    ok = ok && client_request(fd, OP_COVERAGE, NULL, 0, coverage, sizeof(coverage));
+
+    if (ok) {
+        printf("answer 1: %"PRIu64"\n", answer1);
+        printf("answer 2: %"PRIu64"\n", coverage[0]);
+    } else {
+        printf("request failed\n");
+    }
+
+    free(ids.data);
+    close(fd);
+    return ok ? 0 : -1;
+}
+
+typedef struct {
+    const char *socket_path;
+    size_t requests;
+    size_t batch;
+    uint64_t seed;
+    uint64_t *latencies_ns;   // one per request
+    bool failed;
+} LoadgenWorker;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static void *loadgen_worker(void *arg)
+{
+    LoadgenWorker *w = arg;
+    int fd = client_connect(w->socket_path);
+    if (fd < 0) {
+        w->failed = true;
+        return NULL;
+    }
+    uint64_t *ids = malloc(w->batch * sizeof(uint64_t));
+    uint8_t *resp_buf = malloc(sizeof(uint64_t) + w->batch);
+    uint64_t x = w->seed;
+
+    for (size_t r = 0; r < w->requests; ++r) {
+        for (size_t i = 0; i < w->batch; ++i) {
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+            ids[i] = x >> 15; // puzzle ids are below 2^49
+        }
+        uint64_t fresh, start = now_ns();
+        if (!client_query(fd, ids, w->batch, &fresh, resp_buf)) {
+            w->failed = true;
+            break;
+        }
+        w->latencies_ns[r] = now_ns() - start;
+    }
+
+    free(resp_buf);
+    free(ids);
+    close(fd);
+    return NULL;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t v_a = *(const uint64_t *)a;
+    uint64_t v_b = *(const uint64_t *)b;
+    return v_a < v_b ? -1 : v_a > v_b;
+}
+
+// load generator: concurrent connections with random id batches, reports throughput and latency
+static int run_loadgen(const char *socket_path, size_t connections, size_t requests, size_t batch)
+{
+    if (batch > (SERVER_MAX_PAYLOAD / sizeof(uint64_t))) {
+        printf("batch is too large, max is %zu\n", (size_t)(SERVER_MAX_PAYLOAD / sizeof(uint64_t)));
+        return -1;
+    }
+    LoadgenWorker *workers = calloc(connections, sizeof(LoadgenWorker));
+    pthread_t *threads = malloc(connections * sizeof(pthread_t));
+    uint64_t *latencies = calloc(connections * requests, sizeof(uint64_t));
+
+    uint64_t start = now_ns();
+    for (size_t c = 0; c < connections; ++c) {
+        workers[c] = (LoadgenWorker){
+            .socket_path = socket_path,
+            .requests = requests,
+            .batch = batch,
+            .seed = 0x9E3779B97F4A7C15ull * (c + 1),
+            .latencies_ns = latencies + c * requests,
+        };
+        pthread_create(&threads[c], NULL, loadgen_worker, &workers[c]);
+    }
+    bool failed = false;
+    for (size_t c = 0; c < connections; ++c) {
+        pthread_join(threads[c], NULL);
+        failed |= workers[c].failed;
+    }
+    double elapsed = (now_ns() - start) / 1e9;
+
+    if (failed) {
+        printf("some requests failed\n");
+    } else {
+        size_t total = connections * requests;
+        qsort(latencies, total, sizeof(uint64_t), compare_u64);
+        printf("%zu connections, %zu requests of %zu ids in %.3f s\n", connections, total, batch, elapsed);
+        printf("%.0f requests/s, %.0f ids/s\n", total / elapsed, total * batch / elapsed);
+        if (total) {
+            printf("latency us: p50 %.1f, p99 %.1f, p99.9 %.1f, max %.1f\n",
+                latencies[total / 2] / 1e3,
+                latencies[total * 99 / 100] / 1e3,
+                latencies[total * 999 / 1000] / 1e3,
+                latencies[total - 1] / 1e3
+            );
+        }
+    }
+
+    free(latencies);
+    free(threads);
+    free(workers);
+    return failed ? -1 : 0;
+}
+
+static int query_index(const char *index_name, const char *ids_name)
+{
+    RangeIndex index;
+    if (!open_index(&index, index_name)) {
+        return -1;
+    }
+    FILE *f = strcmp(ids_name, "-") == 0 ? stdin : fopen(ids_name, "r");
+    if (!f) {
+        printf("can't open file %s\n", ids_name);
+        munmap((void *)index.header, index.file_size);
+        return -1;
+    }
+
+    uint64_t answer1 = 0;
+    char tmp_str[128];
+    while (fgets(tmp_str, ARRAY_LENGTH(tmp_str), f)) {
+        uint64_t id;
+        IdLine line = parse_id_line(tmp_str, &id);
+        if (line == ID_LINE_BAD) {
+            print_bad_id(tmp_str);
+        }
+        if (line == ID_LINE_ID) {
+            answer1 += index_is_fresh(&index, id);
+        }
+    }
+
+    printf("answer 1: %"PRIu64"\n", answer1);
+    printf("answer 2: %"PRIu64"\n", index.header->covered);
+
+    if (f != stdin) {
+        fclose(f);
+    }
+    munmap((void *)index.header, index.file_size);
+    return 0;
+}
+
+int main(int argv, char* argc[])
+{
+    if (argv < 2) {
+        printf("no input file specified!\n");
+        printf("usage: %s <input>\n", argc[0]);
+        printf("       %s compile <input> <index file>\n", argc[0]);
+        printf("       %s query <index file> <ids file, or - for stdin>\n", argc[0]);
+        printf("       %s dynamic <input, or - for empty set>, commands are read from stdin\n", argc[0]);
+        printf("       %s serve <input> <socket path>\n", argc[0]);
+        printf("       %s client <socket path> <ids file, or - for stdin>\n", argc[0]);
+        printf("       %s loadgen <socket path> [connections] [requests per connection] [ids per request]\n", argc[0]);
+        return -1;
+    }
+
+    if (argv == 4 && strcmp(argc[1], "compile") == 0) {
+        return compile_index(argc[2], argc[3]);
+    }
+    if (argv == 4 && strcmp(argc[1], "query") == 0) {
+        return query_index(argc[2], argc[3]);
+    }
+    if (argv == 3 && strcmp(argc[1], "dynamic") == 0) {
+        return run_dynamic(argc[2]);
+    }
+    if (argv == 4 && strcmp(argc[1], "serve") == 0) {
+        return run_server(argc[2], argc[3]);
+    }
+    if (argv == 4 && strcmp(argc[1], "client") == 0) {
+        return run_client(argc[2], argc[3]);
+    }
+    if (argv >= 3 && strcmp(argc[1], "loadgen") == 0) {
+        long connections = argv > 3 ? atol(argc[3]) : 4;
+        long requests = argv > 4 ? atol(argc[4]) : 10000;
+        long batch = argv > 5 ? atol(argc[5]) : 64;
+        return run_loadgen(argc[2], MAX(connections, 1), MAX(requests, 1), MAX(batch, 1));
+    }
+
+    FILE *f = fopen(argc[1], "r");
+    if (!f) {
+        printf("can't open file %s\n", argc[1]);
+        return -1;
+    }
+
+    Ranges ranges = {0};
+    IDs ids = {0};
+    read_ranges(&ranges, f);
+    read_ids(&ids, f);
+
+    merge_ranges(&ranges);
+
+    // count valid ids for the first task. sorted ids are merge-joined with
+    // ranges, otherwise ids go through Eytzinger lookup
     uint64_t answer1 = 0;
-    for (size_t id_idx = 0; id_idx < ids.length; ++id_idx) {
-        for (size_t ranges_idx = 0; ranges_idx < ranges.length; ++ranges_idx) {
-            if (ids.data[id_idx] >= ranges.data[ranges_idx].min && ids.data[id_idx] <= ranges.data[ranges_idx].max) {
-                ++answer1;
-                break;
+    bool ids_sorted = true;
+    for (size_t id_idx = 1; id_idx < ids.length && ids_sorted; ++id_idx) {
+        ids_sorted = ids.data[id_idx - 1] <= ids.data[id_idx];
+    }
+    if (ids_sorted) {
+        size_t ranges_idx = 0;
+        for (size_t id_idx = 0; id_idx < ids.length; ++id_idx) {
+            while (ranges_idx < ranges.length && ranges.data[ranges_idx].max < ids.data[id_idx]) {
+                ++ranges_idx;
             }
+            answer1 += ranges_idx < ranges.length && ranges.data[ranges_idx].min <= ids.data[id_idx];
         }
+    } else {
+        EytzingerSet set;
+        eytzinger_build(&set, &ranges);
+        answer1 = eytzinger_count_fresh(&set, ids.data, ids.length, NULL);
+        eytzinger_free(&set);
     }
     // calculate answer for the second task
-    uint64_t answer2 = 0;
-    for (size_t ranges_idx = 0; ranges_idx < ranges.length; ++ranges_idx) {
-        answer2 += ranges.data[ranges_idx].max - ranges.data[ranges_idx].min + 1;
-    }
+    uint64_t answer2 = covered_total(&ranges);
 
     printf("answer 1: %"PRIu64"\n", answer1);
     printf("answer 2: %"PRIu64"\n", answer2);
@@ -5,48 +5,396 @@
 #include <stdint.h>
 #include <inttypes.h>
 #include <ctype.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
 #include "common.h"
 
 DARRAY_DEFINE_TYPE(UInt64Array, uint64_t);
-DARRAY_DEFINE_TYPE(String, char);
-DARRAY_DEFINE_TYPE(StringLines, String);
 
-int main(int argv, char* argc[])
+typedef struct {
+    off_t offset;   // row start in the file
+    size_t length;
+} RowInfo;
+
+DARRAY_DEFINE_TYPE(RowInfos, RowInfo);
+
+typedef struct {
+    size_t begin;   // first column
+    size_t end;     // column after the last one
+} Problem;
+
+DARRAY_DEFINE_TYPE(Problems, Problem);
+
+// whole worksheet in one buffer, lines padded with spaces to the same width.
+// last column is always blank, so last problem is closed by it as well.
+// row major: cell is at data[row * cols + col], column major: data[col * rows + row]
+typedef struct {
+    size_t rows;
+    size_t cols;
+    bool column_major;
+    char *data;
+} Worksheet;
+
+static bool load_worksheet(Worksheet *ws, FILE *f)
 {
-    if (argv != 2) {
-        printf("no input file specified!\n");
+    fseek(f, 0, SEEK_END);
+    long file_size = ftell(f);
+    rewind(f);
+    if (file_size <= 0) {
+        return false;
+    }
+    char *file_data = malloc(file_size);
+    size_t size = fread(file_data, 1, file_size, f);
+
+    // line count and max line length, newline at the end of file doesn't start new line
+    size_t max_len = 0, rows = 0;
+    for (size_t pos = 0; pos < size; ++rows) {
+        const char *eol = memchr(file_data + pos, '\n', size - pos);
+        size_t len = eol ? (size_t)(eol - file_data) - pos : size - pos;
+        max_len = MAX(max_len, len);
+        pos += len + 1;
+    }
+
+    ws->rows = rows;
+    ws->cols = max_len + 1;
+    ws->column_major = false;
+    ws->data = malloc(ws->rows * ws->cols);
+    memset(ws->data, ' ', ws->rows * ws->cols);
+
+    size_t pos = 0;
+    for (size_t row = 0; row < rows; ++row) {
+        const char *eol = memchr(file_data + pos, '\n', size - pos);
+        size_t len = eol ? (size_t)(eol - file_data) - pos : size - pos;
+        memcpy(ws->data + row * ws->cols, file_data + pos, len);
+        pos += len + 1;
+    }
+    free(file_data);
+    return rows != 0;
+}
+
+// row major to column major, so problem columns are contiguous in memory
+static void transpose_worksheet(Worksheet *ws)
+{
+    char *transposed = malloc(ws->rows * ws->cols);
+    for (size_t row = 0; row < ws->rows; ++row) {
+        const char *src = ws->data + row * ws->cols;
+        for (size_t col = 0; col < ws->cols; ++col) {
+            transposed[col * ws->rows + row] = src[col];
+        }
+    }
+    free(ws->data);
+    ws->data = transposed;
+    ws->column_major = !ws->column_major;
+}
+
+/*
+    separators are all-space columns. non-space masks of all rows are ORed
+    for 32 columns at once, set bit in the result means column is used
+    by some problem. worksheet must be row major
+*/
+static uint64_t *find_used_columns(const Worksheet *ws)
+{
+    uint64_t *used = calloc((ws->cols + 63) / 64, sizeof(uint64_t));
+    size_t col = 0;
+#ifdef __AVX2__
+    const __m256i spaces = _mm256_set1_epi8(' ');
+    for (; col + 32 <= ws->cols; col += 32) {
+        uint32_t blank = 0xFFFFFFFF;
+        for (size_t row = 0; row < ws->rows; ++row) {
+            __m256i v = _mm256_loadu_si256((const __m256i *)(ws->data + row * ws->cols + col));
+            blank &= (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, spaces));
+        }
+        // col is multiple of 32, so 32 bits never cross the word
+        used[col / 64] |= (uint64_t)~blank << (col % 64);
+    }
+#endif
+    for (; col < ws->cols; ++col) {
+        bool is_used = false;
+        for (size_t row = 0; row < ws->rows; ++row) {
+            is_used |= ws->data[row * ws->cols + col] != ' ';
+        }
+        used[col / 64] |= (uint64_t)is_used << (col % 64);
+    }
+    return used;
+}
+
+// runs of used columns are problems
+static void find_problems(Problems *problems, const uint64_t *used, size_t cols)
+{
+    bool in_problem = false;
+    Problem p = {0};
+    for (size_t col = 0; col < cols; ++col) {
+        bool is_used = (used[col / 64] >> (col % 64)) & 1;
+        if (is_used && !in_problem) {
+            p.begin = col;
+        } else if (!is_used && in_problem) {
+            p.end = col;
+            DARRAY_PUSH(*problems, p);
+        }
+        in_problem = is_used;
+    }
+}
+
+static inline uint64_t apply_operator(char op, uint64_t result, uint64_t value)
+{
+    return op == '+' ? result + value : result * value;
+}
+
+// both readings of a single problem, worksheet must be row major
+static void solve_problem(const Worksheet *ws, Problem p, uint64_t *answer1, uint64_t *answer2)
+{
+    const size_t digit_rows = ws->rows - 1;
+    const char *operators = ws->data + digit_rows * ws->cols;
+    char op = 0;
+    for (size_t col = p.begin; col < p.end; ++col) {
+        op = operators[col] != ' ' ? operators[col] : op;
+    }
+    // task 1: one number per row
+    uint64_t result = op == '*';
+    for (size_t row = 0; row < digit_rows; ++row) {
+        const char *line = ws->data + row * ws->cols;
+        uint64_t number = 0;
+        for (size_t col = p.begin; col < p.end; ++col) {
+            if (isdigit(line[col])) {
+                number = number * 10 + (line[col] - '0');
+            }
+        }
+        result = apply_operator(op, result, number);
+    }
+    *answer1 += result;
+    // task 2: one number per column
+    result = op == '*';
+    for (size_t col = p.begin; col < p.end; ++col) {
+        uint64_t number = 0;
+        for (size_t row = 0; row < digit_rows; ++row) {
+            char c = ws->data[row * ws->cols + col];
+            if (isdigit(c)) {
+                number = number * 10 + (c - '0');
+            }
+        }
+        result = apply_operator(op, result, number);
+    }
+    *answer2 += result;
+}
+
+typedef struct {
+    const Worksheet *ws;
+    const Problem *problems;
+    size_t problems_cnt;
+    uint64_t answer1;
+    uint64_t answer2;
+} ProblemsChunk;
+
+static void *solve_chunk(void *arg)
+{
+    ProblemsChunk *chunk = arg;
+    for (size_t i = 0; i < chunk->problems_cnt; ++i) {
+        solve_problem(chunk->ws, chunk->problems[i], &chunk->answer1, &chunk->answer2);
+    }
+    return NULL;
+}
+
+// two phases: find separator columns, then solve independent problems in parallel
+static void solve_parallel(const Worksheet *ws, size_t threads_cnt)
+{
+    uint64_t *used = find_used_columns(ws);
+    Problems problems = {0};
+    find_problems(&problems, used, ws->cols);
+    free(used);
+
+    threads_cnt = MAX(MIN(threads_cnt, problems.length), 1);
+    ProblemsChunk *chunks = calloc(threads_cnt, sizeof(ProblemsChunk));
+    pthread_t *threads = malloc(threads_cnt * sizeof(pthread_t));
+    for (size_t t = 0; t < threads_cnt; ++t) {
+        size_t begin = problems.length * t / threads_cnt;
+        size_t end = problems.length * (t + 1) / threads_cnt;
+        chunks[t] = (ProblemsChunk){ .ws = ws, .problems = problems.data + begin, .problems_cnt = end - begin };
+        pthread_create(&threads[t], NULL, solve_chunk, &chunks[t]);
+    }
+    // partial sums are combined in chunk order
+    uint64_t answer1 = 0, answer2 = 0;
+    for (size_t t = 0; t < threads_cnt; ++t) {
+        pthread_join(threads[t], NULL);
+        answer1 += chunks[t].answer1;
+        answer2 += chunks[t].answer2;
+    }
+
+    printf("answer 1: %"PRIu64"\n", answer1);
+    printf("answer 2: %"PRIu64"\n", answer2);
+
+    free(threads);
+    free(chunks);
+    free(problems.data);
+}
+
+#define STREAM_READ_SIZE (1 << 20)
+#define STREAM_DEFAULT_WINDOW (64 << 10)
+
+/*
+    streaming version for very wide worksheets: row offsets are found once,
+    then all rows are read in lockstep, one window of columns per row at a time
+    with pread. problem is solved as soon as blank column closes it, both
+    readings are folded on the fly, so memory is O(rows * window)
+*/
+static int solve_stream(const char *file_name, size_t window)
+{
+    int fd = open(file_name, O_RDONLY);
+    if (fd < 0) {
+        printf("can't open file %s\n", file_name);
         return -1;
     }
 
-    FILE *f = fopen(argc[1], "r");
-    if (!f) {
-        printf("can't open file %s\n", argc[1]);
+    // find rows, newline at the end of file doesn't start new line
+    RowInfos rows = {0};
+    char *read_buf = malloc(STREAM_READ_SIZE);
+    RowInfo row = {0};
+    off_t file_pos = 0;
+    ssize_t read_len;
+    while ((read_len = pread(fd, read_buf, STREAM_READ_SIZE, file_pos)) > 0) {
+        for (char *p = read_buf, *end = read_buf + read_len; p < end;) {
+            char *eol = memchr(p, '\n', end - p);
+            if (!eol) {
+                row.length += end - p;
+                break;
+            }
+            row.length += eol - p;
+            DARRAY_PUSH(rows, row);
+            row = (RowInfo){ .offset = file_pos + (eol - read_buf) + 1 };
+            p = eol + 1;
+        }
+        file_pos += read_len;
+    }
+    free(read_buf);
+    if (row.length) {
+        DARRAY_PUSH(rows, row);
+    }
+    if (rows.length == 0) {
+        printf("worksheet is empty\n");
+        close(fd);
         return -1;
     }
 
-    StringLines file_lines = {0};
-    size_t max_len = 0;
-    // read lines
-    while(true) {
-        int c;
-        String tmp = {0};
+    size_t cols = 0;
+    for (size_t r = 0; r < rows.length; ++r) {
+        cols = MAX(cols, rows.data[r].length);
+    }
+    ++cols; // blank column closing the last problem
 
-        for (c = fgetc(f); c != '\n' && c != EOF; c = fgetc(f)) {
-            DARRAY_PUSH(tmp, c);
+    const size_t digit_rows = rows.length - 1;
+    char *windows = malloc(rows.length * window);
+    UInt64Array tsk1_numbers = {0};
+    DARRAY_RESIZE(tsk1_numbers, digit_rows);
+    memset(tsk1_numbers.data, 0, DARRAY_BYTE_SIZE(tsk1_numbers));
+
+    uint64_t answer1 = 0, answer2 = 0;
+    uint64_t tsk2_sum = 0, tsk2_product = 1;
+    char current_operator = 0;
+    bool in_problem = false;
+
+    for (size_t block = 0; block < cols; block += window) {
+        const size_t block_len = MIN(window, cols - block);
+        // advance all row cursors to the next window, short rows are padded with spaces
+        for (size_t r = 0; r < rows.length; ++r) {
+            char *row_window = windows + r * window;
+            size_t available = rows.data[r].length > block ? MIN(block_len, rows.data[r].length - block) : 0;
+            size_t got = 0;
+            while (got < available) {
+                ssize_t n = pread(fd, row_window + got, available - got, rows.data[r].offset + block + got);
+                if (n <= 0) break;
+                got += n;
+            }
+            memset(row_window + got, ' ', block_len - got);
         }
-        DARRAY_PUSH(file_lines, tmp);
-        max_len = MAX(max_len, tmp.length);
-        if (c == EOF) {
-            break;
+
+        for (size_t col = 0; col < block_len; ++col) {
+            bool all_spaces = true;
+            uint64_t tsk2_curr_number = 0;
+            for (size_t r = 0; r < digit_rows; ++r) {
+                char c = windows[r * window + col];
+                if (isdigit(c)) {
+                    tsk1_numbers.data[r] = tsk1_numbers.data[r] * 10 + (c - '0');
+                    tsk2_curr_number = tsk2_curr_number * 10 + (c - '0');
+                }
+                all_spaces &= c == ' ';
+            }
+            char op = windows[digit_rows * window + col];
+            current_operator = op != ' ' ? op : current_operator;
+            all_spaces &= op == ' ';
+
+            if (!all_spaces) {
+                tsk2_sum += tsk2_curr_number;
+                tsk2_product *= tsk2_curr_number;
+                in_problem = true;
+            } else if (in_problem) {
+                // time to do math
+                uint64_t result = current_operator == '*';
+                for (size_t r = 0; r < digit_rows; ++r) {
+                    result = apply_operator(current_operator, result, tsk1_numbers.data[r]);
+                    tsk1_numbers.data[r] = 0;
+                }
+                answer1 += result;
+                answer2 += current_operator == '+' ? tsk2_sum : tsk2_product;
+                // cleanup for the next problem
+                tsk2_sum = 0;
+                tsk2_product = 1;
+                in_problem = false;
+            }
         }
     }
-    // make all strings the same length, simplifying next step
-    for (size_t i = 0; i < file_lines.length; ++i) {
-        while(file_lines.data[i].length < max_len + 1) {
-            DARRAY_PUSH(file_lines.data[i], ' ');
-        }
+
+    printf("answer 1: %"PRIu64"\n", answer1);
+    printf("answer 2: %"PRIu64"\n", answer2);
+
+    free(tsk1_numbers.data);
+    free(windows);
+    free(rows.data);
+    close(fd);
+    return 0;
+}
+
+int main(int argv, char* argc[])
+{
+    if (argv < 2) {
+        printf("no input file specified!\n");
+        printf("usage: %s [parallel] <input> [threads]\n", argc[0]);
+        printf("       %s stream <input> [window bytes]\n", argc[0]);
+        return -1;
     }
+
+    if (argv >= 3 && strcmp(argc[1], "stream") == 0) {
+        long window = argv >= 4 ? atol(argc[3]) : STREAM_DEFAULT_WINDOW;
+        return solve_stream(argc[2], window > 0 ? window : STREAM_DEFAULT_WINDOW);
+    }
+
+    bool parallel = argv >= 3 && strcmp(argc[1], "parallel") == 0;
+    const char *file_name = parallel ? argc[2] : argc[1];
+
+    FILE *f = fopen(file_name, "r");
+    if (!f) {
+        printf("can't open file %s\n", file_name);
+        return -1;
+    }
+
+    Worksheet ws;
+    if (!load_worksheet(&ws, f)) {
+        printf("worksheet is empty\n");
+        fclose(f);
+        return -1;
+    }
+    if (parallel) {
+        long threads_cnt = argv >= 4 ? atol(argc[3]) : sysconf(_SC_NPROCESSORS_ONLN);
+        solve_parallel(&ws, threads_cnt > 0 ? threads_cnt : 1);
+        free(ws.data);
+        fclose(f);
+        return 0;
+    }
+    transpose_worksheet(&ws);
     // why we should go from right to left, as task suggests?
     // it works in both directions, i prefer to do it from left to right
     uint64_t answer1 = 0;
@@ -55,22 +403,23 @@ int main(int argv, char* argc[])
     char current_operator = 0;
 
     UInt64Array tsk1_numbers = {0};
-    for (size_t line_idx = 0; line_idx < file_lines.length - 1; ++line_idx) {
+    for (size_t line_idx = 0; line_idx < ws.rows - 1; ++line_idx) {
         DARRAY_PUSH(tsk1_numbers, 0);
     }
 
     UInt64Array tsk2_numbers = {0};
 
-    for (size_t col = 0; col <= max_len; ++col) {
+    for (size_t col = 0; col < ws.cols; ++col) {
         // all spaces means all data for operation received
         bool all_spaces = true;
 
         uint64_t tsk2_curr_number = 0;
+        const char *column = ws.data + col * ws.rows;
 
-        for (size_t line_idx = 0; line_idx < file_lines.length; ++line_idx) {
-            char c = file_lines.data[line_idx].data[col];
-            
-            if (line_idx != (file_lines.length - 1)) {
+        for (size_t line_idx = 0; line_idx < ws.rows; ++line_idx) {
+            char c = column[line_idx];
+
+            if (line_idx != (ws.rows - 1)) {
                 // digits line
                 if (isdigit(c)) {
                     tsk1_numbers.data[line_idx] = tsk1_numbers.data[line_idx] * 10 + (c - '0');
@@ -87,19 +436,19 @@ int main(int argv, char* argc[])
         }
         if (!all_spaces) {
             DARRAY_PUSH(tsk2_numbers, tsk2_curr_number);
-        } else {
+        } else if (tsk2_numbers.length) {
             // time to do math
             uint64_t result;
-            // task 1
-            result = tsk1_numbers.data[0];
-            for (size_t i = 1; i< tsk1_numbers.length; ++i) {
-                result = current_operator == '+' ? result + tsk1_numbers.data[i] : result * tsk1_numbers.data[i];
+            // task 1, single line worksheet has operators only and no numbers
+            result = current_operator == '*';
+            for (size_t i = 0; i < tsk1_numbers.length; ++i) {
+                result = apply_operator(current_operator, result, tsk1_numbers.data[i]);
             }
             answer1 += result;
             // task 2
-            result = tsk2_numbers.data[0];
-            for (size_t i = 1; i < tsk2_numbers.length; ++i) {
-                result = current_operator == '+' ? result + tsk2_numbers.data[i] : result * tsk2_numbers.data[i];
+            result = current_operator == '*';
+            for (size_t i = 0; i < tsk2_numbers.length; ++i) {
+                result = apply_operator(current_operator, result, tsk2_numbers.data[i]);
             }
             answer2 += result;
             // cleanup for the next iteration
@@ -111,11 +460,7 @@ int main(int argv, char* argc[])
     printf("answer 1: %"PRIu64"\n", answer1);
     printf("answer 2: %"PRIu64"\n", answer2);
 
-    for (size_t i = 0; i < file_lines.length; ++i) {
-        free(file_lines.data[i].data);
-    }
-
-    free(file_lines.data);
+    free(ws.data);
     free(tsk1_numbers.data);
     free(tsk2_numbers.data);
 
@@ -8,44 +8,319 @@
 
 #include "common.h"
 
-enum {
-    TREE_START = -1,
-    TREE_SPLIT = -2,
-};
+// timelines double on every split, deep manifolds don't fit 64 bits
+typedef unsigned __int128 Count;
 
-DARRAY_DEFINE_TYPE(IntArray, int64_t);
+DARRAY_DEFINE_TYPE(U64Array, uint64_t);
 
-// read and parse into int array (allows to count combinations inplace)
-bool read_line(IntArray *a, FILE *f)
+// active beam in sparse layout
+typedef struct {
+    size_t col;
+    Count count;
+} Beam;
+
+DARRAY_DEFINE_TYPE(BeamArray, Beam);
+
+// one manifold row: splitters are bits, 64 columns per word
+typedef struct {
+    char *line;
+    size_t line_cap;
+    size_t width;           // width of the first row, the rest is cut or padded to it
+    size_t words;
+    U64Array splitters;
+    size_t start_col;       // column of 'S', SIZE_MAX if there is none
+} RowReader;
+
+// read next row into splitters bitmask
+bool read_line(RowReader *r, FILE *f)
+{
+    ssize_t len = getline(&r->line, &r->line_cap, f);
+    while (len > 0 && (r->line[len - 1] == '\n' || r->line[len - 1] == '\r')) --len;
+    if (len <= 0) {
+        return false;
+    }
+    if (!r->width) {
+        r->width = len;
+        r->words = (r->width + 63) / 64;
+        DARRAY_RESIZE(r->splitters, r->words);
+    }
+    memset(r->splitters.data, 0, DARRAY_BYTE_SIZE(r->splitters));
+    r->start_col = SIZE_MAX;
+
+    const size_t cols = MIN((size_t)len, r->width);
+    for (size_t col = 0; col < cols; ++col) {
+        r->splitters.data[col / 64] |= (uint64_t)(r->line[col] == '^') << (col % 64);
+        if (r->line[col] == 'S') {
+            r->start_col = col;
+        }
+    }
+    return true;
+}
+
+typedef enum {
+    LAYOUT_AUTO,
+    LAYOUT_DENSE,
+    LAYOUT_SPARSE,
+} Layout;
+
+// switch to dense above 1/8 of columns carrying beams, back to sparse below 1/32
+#define DENSE_OCCUPANCY_DIV 8
+#define SPARSE_OCCUPANCY_DIV 32
+
+typedef struct {
+    size_t width;
+    size_t words;
+    Layout layout;          // forced layout, or auto switching by occupancy
+    bool sparse;            // current layout
+    bool overflow;          // some count wrapped around 128 bits
+    // dense: beams bitmask, hits with one zero word on each side,
+    // counts with one padding lane in front
+    uint64_t *beams;
+    uint64_t *hits;
+    Count *counts;
+    // sparse: active beams sorted by column, and merge buffers
+    BeamArray active;
+    BeamArray right;
+    BeamArray left;
+} Manifold;
+
+static void print_u128(Count v)
+{
+    char buf[40];
+    size_t pos = sizeof(buf);
+    buf[--pos] = '\0';
+    do {
+        buf[--pos] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    printf("%s", buf + pos);
+}
+
+static inline void add_count(Manifold *m, Count *dst, Count v)
+{
+    m->overflow |= __builtin_add_overflow(*dst, v, dst);
+}
+
+// append keeping columns unique, beams at the same column are summed
+static inline void push_beam(Manifold *m, BeamArray *a, size_t col, Count count)
+{
+    if (a->length && a->data[a->length - 1].col == col) {
+        add_count(m, &a->data[a->length - 1].count, count);
+    } else {
+        Beam b = {.col = col, .count = count};
+        DARRAY_PUSH(*a, b);
+    }
+}
+
+static void manifold_init(Manifold *m, size_t width, size_t words, Layout layout, size_t start_col)
+{
+    memset(m, 0, sizeof(*m));
+    m->width = width;
+    m->words = words;
+    m->layout = layout;
+    m->beams = calloc(words, sizeof(uint64_t));
+    m->hits = (uint64_t *)calloc(words + 2, sizeof(uint64_t)) + 1;
+    m->counts = (Count *)calloc(words * 64 + 1, sizeof(Count)) + 1;
+    // single beam at the start, so sparse unless dense is forced
+    m->sparse = layout != LAYOUT_DENSE;
+    if (m->sparse) {
+        push_beam(m, &m->active, start_col, 1);
+    } else {
+        m->beams[start_col / 64] |= (uint64_t)1 << (start_col % 64);
+        m->counts[start_col] = 1;
+    }
+}
+
+static void manifold_free(Manifold *m)
+{
+    free(m->beams);
+    free(m->hits - 1);
+    free(m->counts - 1);
+    free(m->active.data);
+    free(m->right.data);
+    free(m->left.data);
+}
+
+static void to_sparse(Manifold *m)
+{
+    m->active.length = 0;
+    for (size_t w = 0; w < m->words; ++w) {
+        for (uint64_t bits = m->beams[w]; bits; bits &= bits - 1) {
+            size_t col = w * 64 + __builtin_ctzll(bits);
+            push_beam(m, &m->active, col, m->counts[col]);
+        }
+    }
+    m->sparse = true;
+}
+
+static void to_dense(Manifold *m)
+{
+    memset(m->beams, 0, m->words * sizeof(uint64_t));
+    memset(m->counts - 1, 0, (m->words * 64 + 1) * sizeof(Count));
+    for (size_t i = 0; i < m->active.length; ++i) {
+        const Beam *b = &m->active.data[i];
+        m->beams[b->col / 64] |= (uint64_t)1 << (b->col % 64);
+        m->counts[b->col] = b->count;
+    }
+    m->sparse = false;
+}
+
+// 64 columns at once: beams hitting splitters are AND of the masks,
+// counts are only touched in words with hits. returns number of splits
+static uint64_t dense_step(Manifold *m, const uint64_t *splitters)
+{
+    const size_t words = m->words;
+    uint64_t *beams = m->beams, *hits = m->hits;
+    uint64_t splits = 0;
+
+    for (size_t w = 0; w < words; ++w) {
+        hits[w] = beams[w] & splitters[w];
+        splits += __builtin_popcountll(hits[w]);
+    }
+    if (!splits) {
+        return 0;
+    }
+    // split beams go to the left and right neighbour columns
+    for (size_t w = 0; w < words; ++w) {
+        uint64_t left = (hits[w] >> 1) | (hits[w + 1] << 63);
+        uint64_t right = (hits[w] << 1) | (hits[w - 1] >> 63);
+        beams[w] = (beams[w] & ~hits[w]) | left | right;
+    }
+    if (m->width % 64) {
+        beams[words - 1] &= ((uint64_t)1 << (m->width % 64)) - 1;
+    }
+    // counts: 64 lanes per word, split lanes are masked out of the count
+    // and added back shifted by one lane to the left and right. the right
+    // half from the last lane is carried to the next word after its split
+    // lanes are taken, split beams past the edges are dropped
+    bool overflow = false;
+    Count carry = 0;
+    for (size_t w = 0; w < words; ++w) {
+        Count *lanes = m->counts + w * 64;
+        if (!hits[w]) {
+            overflow |= __builtin_add_overflow(lanes[0], carry, &lanes[0]);
+            carry = 0;
+            continue;
+        }
+        Count split[66] = {0};
+        for (size_t j = 0; j < 64; ++j) {
+            split[j + 1] = lanes[j] & -(Count)((hits[w] >> j) & 1);
+        }
+        for (size_t j = 0; j < 64; ++j) {
+            lanes[j] -= split[j + 1];
+        }
+        for (size_t j = 0; j < 64; ++j) {
+            overflow |= __builtin_add_overflow(lanes[j], split[j], &lanes[j]);
+            overflow |= __builtin_add_overflow(lanes[j], split[j + 2], &lanes[j]);
+        }
+        overflow |= __builtin_add_overflow(lanes[0], carry, &lanes[0]);
+        overflow |= __builtin_add_overflow(lanes[-1], split[1], &lanes[-1]);
+        carry = split[64];
+    }
+    m->counts[-1] = 0;
+    m->overflow |= overflow;
+    return splits;
+}
+
+// straight beams and right halves of split beams are sorted by column,
+// and so are the left halves: two pointer merge of both. returns number of splits
+static uint64_t sparse_step(Manifold *m, const uint64_t *splitters)
+{
+    uint64_t splits = 0;
+    for (size_t i = 0; i < m->active.length; ++i) {
+        size_t col = m->active.data[i].col;
+        splits += (splitters[col / 64] >> (col % 64)) & 1;
+    }
+    if (!splits) {
+        return 0;
+    }
+
+    m->right.length = m->left.length = 0;
+    for (size_t i = 0; i < m->active.length; ++i) {
+        const Beam b = m->active.data[i];
+        if ((splitters[b.col / 64] >> (b.col % 64)) & 1) {
+            if (b.col > 0) {
+                push_beam(m, &m->left, b.col - 1, b.count);
+            }
+            if (b.col + 1 < m->width) {
+                push_beam(m, &m->right, b.col + 1, b.count);
+            }
+        } else {
+            push_beam(m, &m->right, b.col, b.count);
+        }
+    }
+
+    m->active.length = 0;
+    size_t r = 0, l = 0;
+    while (r < m->right.length || l < m->left.length) {
+        const Beam *b;
+        if (l == m->left.length || (r < m->right.length && m->right.data[r].col < m->left.data[l].col)) {
+            b = &m->right.data[r++];
+        } else {
+            b = &m->left.data[l++];
+        }
+        push_beam(m, &m->active, b->col, b->count);
+    }
+    return splits;
+}
+
+static size_t active_beams(const Manifold *m)
 {
-    a->length = 0;
-    for (int c = fgetc(f); c != '\n' && c != EOF; c = fgetc(f)) {
-        int64_t v = 0;
-        if (c == 'S') {
-            v = TREE_START;
-        } else if (c == '^') {
-            v = TREE_SPLIT;
+    if (m->sparse) {
+        return m->active.length;
+    }
+    size_t cnt = 0;
+    for (size_t w = 0; w < m->words; ++w) {
+        cnt += __builtin_popcountll(m->beams[w]);
+    }
+    return cnt;
+}
+
+static Count total_count(Manifold *m)
+{
+    Count total = 0;
+    if (m->sparse) {
+        for (size_t i = 0; i < m->active.length; ++i) {
+            add_count(m, &total, m->active.data[i].count);
+        }
+    } else {
+        for (size_t i = 0; i < m->width; ++i) {
+            add_count(m, &total, m->counts[i]);
         }
-        DARRAY_PUSH(*a, v);
     }
-    return a->length;
+    return total;
 }
 
 int main(int argv, char* argc[])
 {
-    if (argv != 2) {
+    if (argv < 2) {
         printf("no input file specified!\n");
+        printf("usage: %s [dense|sparse] <input>\n", argc[0]);
         return -1;
     }
 
-    FILE *f = fopen(argc[1], "r");
+    Layout layout = LAYOUT_AUTO;
+    const char *file_name = argc[1];
+    if (argv >= 3) {
+        if (strcmp(argc[1], "dense") == 0) {
+            layout = LAYOUT_DENSE;
+        } else if (strcmp(argc[1], "sparse") == 0) {
+            layout = LAYOUT_SPARSE;
+        } else {
+            printf("unknown mode %s\n", argc[1]);
+            return -1;
+        }
+        file_name = argc[2];
+    }
+
+    FILE *f = fopen(file_name, "r");
     if (!f) {
-        printf("can't open file %s\n", argc[1]);
+        printf("can't open file %s\n", file_name);
         return -1;
     }
 
-    IntArray first_line = {0}, second_line = {0};
-    uint64_t answer1 = 0, answer2 = 0;
+    RowReader reader = {0};
+    uint64_t answer1 = 0;
 
     /*
         propagate combinations down. '^' adds number above to the left and right, 
@@ -61,39 +336,49 @@ int main(int argv, char* argc[])
         ....1.3.3.1....
         ...1^4^331^1...
         ...1.4.331.1...
+
+        few beams are kept as sorted (column, count) list, many as bitmask
+        and counts array. layout follows number of active beams
     */
 
-    read_line(&first_line, f);
-    while(read_line(&second_line, f)) {
-        for (size_t i = 0; i < first_line.length; ++i) {
-            int64_t v = first_line.data[i];
-            if (v == TREE_START) {
-                second_line.data[i] = 1;
-            } else if (v > 0) {
-                if (second_line.data[i] == TREE_SPLIT) {
-                    second_line.data[i-1] = second_line.data[i-1] + v;
-                    second_line.data[i+1] = second_line.data[i+1] + v;
-                    ++answer1; // beam split
-                } else {
-                    second_line.data[i] = second_line.data[i] + v;
-                }
-            }
+    if (!read_line(&reader, f) || reader.start_col == SIZE_MAX) {
+        printf("no start in the first line\n");
+        free(reader.splitters.data);
+        free(reader.line);
+        fclose(f);
+        return -1;
+    }
+
+    Manifold m;
+    manifold_init(&m, reader.width, reader.words, layout, reader.start_col);
+
+    while (read_line(&reader, f)) {
+        uint64_t splits = m.sparse ? sparse_step(&m, reader.splitters.data) : dense_step(&m, reader.splitters.data);
+        answer1 += splits; // beam split
+        if (layout != LAYOUT_AUTO || !splits) {
+            continue;
+        }
+        size_t active = active_beams(&m);
+        if (m.sparse && active > m.width / DENSE_OCCUPANCY_DIV) {
+            to_dense(&m);
+        } else if (!m.sparse && active < m.width / SPARSE_OCCUPANCY_DIV) {
+            to_sparse(&m);
         }
-        // swap lines
-        IntArray tmp = first_line;
-        first_line = second_line;
-        second_line = tmp;
     }
     // this is final line, calcualte answer 2
-    for(size_t i = 0; i < first_line.length; ++i) {
-        answer2 += first_line.data[i];
-    }
+    Count answer2 = total_count(&m);
 
     printf("answer 1: %"PRIu64"\n", answer1);
-    printf("answer 2: %"PRIu64"\n", answer2);
+    printf("answer 2: ");
+    print_u128(answer2);
+    printf("\n");
+    if (m.overflow) {
+        printf("answer 2 overflows 128 bits, printed value is modulo 2^128\n");
+    }
 
-    free(first_line.data);
-    free(second_line.data);
+    manifold_free(&m);
+    free(reader.splitters.data);
+    free(reader.line);
 
     fclose(f);
     return 0;
@@ -1,32 +1,83 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <stdbool.h>
-#include <math.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
 #include "common.h"
 
+#define DEFAULT_CONNECTIONS 1000 // 10 for the example
+#define NO_DISTANCE UINT64_MAX
+#define NO_BOX UINT32_MAX
+#define DISTANCE_TILE 1024
+#define RADIX_BITS 8
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+
+DARRAY_DEFINE_TYPE(Coords, int32_t);
+
+// boxes as separate coordinate arrays, so distance kernel loads 8 boxes at once
+typedef struct {
+    Coords x;
+    Coords y;
+    Coords z;
+} JunctionBoxes;
+
+// only order of distances matters, so it is exact squared distance.
+// box indices are 32 bit to keep all pairs list small
 typedef struct {
-    double x;
-    double y;
-    double z;
-    size_t circuit_id;
-} JunctionBox;
+    uint64_t distance;
+    uint32_t a_idx;
+    uint32_t b_idx;
+} Connection;
 
 typedef struct {
-    size_t a_idx;
-    size_t b_idx;
-} IdxPair;
+    const JunctionBoxes *boxes;
+    size_t a_begin;         // rows of pairs (a, b > a)
+    size_t a_end;
+    Connection *connections;
+} ConnectionsChunk;
 
+// shortest pairs of rows [a_begin, a_end), bounded max heap
 typedef struct {
-    size_t circuit_id;
-    size_t count;
-} CircuiInfo;
+    const JunctionBoxes *boxes;
+    size_t a_begin;
+    size_t a_end;
+    size_t k;
+    size_t heap_len;
+    Connection *heap;       // k entries, longest of them on top
+} TopKChunk;
 
-DARRAY_DEFINE_TYPE(JunctionBoxArray, JunctionBox);
-DARRAY_DEFINE_TYPE(IdxPairs, IdxPair);
-DARRAY_DEFINE_TYPE(CircuiInfoArray, CircuiInfo);
+// one pass of LSD radix sort over a range of connections
+typedef struct {
+    const Connection *src;
+    Connection *dst;
+    size_t begin;
+    size_t end;
+    unsigned shift;
+    size_t counts[RADIX_BUCKETS];   // digit histogram, then output offsets
+} RadixChunk;
 
-static bool read_point(JunctionBox *p, FILE *f) {
+// circuit size entry of profile mode heap
+typedef struct {
+    size_t size;
+    size_t root;
+} CircuitSize;
+
+DARRAY_DEFINE_TYPE(CircuitSizes, CircuitSize);
+
+// union-find over boxes, circuit is identified by its root box
+typedef struct {
+    size_t *parent;
+    size_t *size;           // circuit size, valid for roots only
+    size_t count;           // number of circuits
+} Circuits;
+
+static bool read_point(int32_t p[3], FILE *f) {
     int coord[3] = {0};
     size_t coord_idx = 0;
     for (int c = fgetc(f); c != '\n' && c != EOF; c = fgetc(f)) {
@@ -39,155 +90,1163 @@ static bool read_point(JunctionBox *p, FILE *f) {
     if (coord_idx != 2) {
         return false;
     }
-    p->x = coord[0];
-    p->y = coord[1];
-    p->z = coord[2];
+    for (size_t i = 0; i < 3; ++i) {
+        p[i] = coord[i];
+    }
     return true;
 }
 
-static double point_distance(JunctionBox p1, JunctionBox p2)
+// coordinates are non negative int32, so the sum of squares fits in 64 bits
+static uint64_t box_distance(const JunctionBoxes *boxes, size_t a_idx, size_t b_idx)
 {
-    return sqrt(pow(p1.x - p2.x, 2) + pow(p1.y - p2.y, 2) + pow(p1.z - p2.z, 2));
+    int64_t dx = (int64_t)boxes->x.data[a_idx] - boxes->x.data[b_idx];
+    int64_t dy = (int64_t)boxes->y.data[a_idx] - boxes->y.data[b_idx];
+    int64_t dz = (int64_t)boxes->z.data[a_idx] - boxes->z.data[b_idx];
+    return (uint64_t)(dx * dx) + (uint64_t)(dy * dy) + (uint64_t)(dz * dz);
 }
 
-static bool contains_index_pair(IdxPairs *pairs, size_t a_idx, size_t b_idx) 
+// pairs (a, b > a) are stored row by row
+static size_t connection_offset(size_t boxes_cnt, size_t a_idx, size_t b_idx)
 {
-    for (size_t i = 0; i < pairs->length; ++i) {
-        bool found =
-            (pairs->data[i].a_idx == a_idx && pairs->data[i].b_idx == b_idx) ||
-            (pairs->data[i].a_idx == b_idx && pairs->data[i].b_idx == a_idx);
-        if (found) {
-            return true;
+    return a_idx * boxes_cnt - a_idx * (a_idx + 1) / 2 + (b_idx - a_idx - 1);
+}
+
+// distances from box a to boxes [b_begin, b_end)
+static void distances_row(const JunctionBoxes *boxes, size_t a_idx, size_t b_begin, size_t b_end, Connection *out)
+{
+    size_t b_idx = b_begin;
+#ifdef __AVX2__
+    // 8 boxes per step: 32 bit differences, squares are 64 bit, even and odd lanes separately
+    const __m256i ax = _mm256_set1_epi32(boxes->x.data[a_idx]);
+    const __m256i ay = _mm256_set1_epi32(boxes->y.data[a_idx]);
+    const __m256i az = _mm256_set1_epi32(boxes->z.data[a_idx]);
+    for (; b_idx + 8 <= b_end; b_idx += 8) {
+        __m256i dx = _mm256_sub_epi32(ax, _mm256_loadu_si256((const __m256i *)&boxes->x.data[b_idx]));
+        __m256i dy = _mm256_sub_epi32(ay, _mm256_loadu_si256((const __m256i *)&boxes->y.data[b_idx]));
+        __m256i dz = _mm256_sub_epi32(az, _mm256_loadu_si256((const __m256i *)&boxes->z.data[b_idx]));
+        __m256i even = _mm256_add_epi64(_mm256_add_epi64(_mm256_mul_epi32(dx, dx), _mm256_mul_epi32(dy, dy)), _mm256_mul_epi32(dz, dz));
+        dx = _mm256_srli_epi64(dx, 32);
+        dy = _mm256_srli_epi64(dy, 32);
+        dz = _mm256_srli_epi64(dz, 32);
+        __m256i odd = _mm256_add_epi64(_mm256_add_epi64(_mm256_mul_epi32(dx, dx), _mm256_mul_epi32(dy, dy)), _mm256_mul_epi32(dz, dz));
+        // back to box order: 0 1 4 5 and 2 3 6 7 -> 0 1 2 3 and 4 5 6 7
+        __m256i lo = _mm256_unpacklo_epi64(even, odd);
+        __m256i hi = _mm256_unpackhi_epi64(even, odd);
+        uint64_t distance[8];
+        _mm256_storeu_si256((__m256i *)&distance[0], _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256((__m256i *)&distance[4], _mm256_permute2x128_si256(lo, hi, 0x31));
+        for (size_t i = 0; i < 8; ++i) {
+            out->distance = distance[i];
+            out->a_idx = a_idx;
+            out->b_idx = b_idx + i;
+            ++out;
         }
     }
-    return false;
+#endif
+    for (; b_idx < b_end; ++b_idx) {
+        out->distance = box_distance(boxes, a_idx, b_idx);
+        out->a_idx = a_idx;
+        out->b_idx = b_idx;
+        ++out;
+    }
 }
 
-static void connect_boxes(JunctionBoxArray *boxes, size_t a_idx, size_t b_idx)
+// pairs of rows [a_begin, a_end), in tiles of boxes so coordinates of both
+// tiles stay in cache
+static void fill_connections(const JunctionBoxes *boxes, size_t a_begin, size_t a_end, Connection *connections)
 {
-    // set all b circuit ids to a circuit id
-    size_t a_circuit_id = boxes->data[a_idx].circuit_id;
-    size_t b_circuit_id = boxes->data[b_idx].circuit_id;
-
-    for (size_t box_idx = 0; box_idx < boxes->length; ++box_idx) {
-        if (boxes->data[box_idx].circuit_id == b_circuit_id) {
-            boxes->data[box_idx].circuit_id = a_circuit_id;
+    const size_t boxes_cnt = boxes->x.length;
+    for (size_t a_tile = a_begin; a_tile < a_end; a_tile += DISTANCE_TILE) {
+        const size_t a_tile_end = MIN(a_tile + DISTANCE_TILE, a_end);
+        for (size_t b_tile = a_tile; b_tile < boxes_cnt; b_tile += DISTANCE_TILE) {
+            const size_t b_end = MIN(b_tile + DISTANCE_TILE, boxes_cnt);
+            for (size_t a_idx = a_tile; a_idx < a_tile_end; ++a_idx) {
+                const size_t b_begin = MAX(b_tile, a_idx + 1);
+                if (b_begin < b_end) {
+                    distances_row(boxes, a_idx, b_begin, b_end, connections + connection_offset(boxes_cnt, a_idx, b_begin));
+                }
+            }
         }
     }
 }
 
-static int compare_circuit_info(const void *a, const void *b)
+// shortest first, ties in box order, same as scanning pairs a < b
+static int compare_connections(const void *a, const void *b)
 {
-    CircuiInfo *c_a = (CircuiInfo *)a;
-    CircuiInfo *c_b = (CircuiInfo *)b;
-    if (c_a->count < c_b->count) return 1;
-    if (c_a->count > c_b->count) return -1;
+    const Connection *c_a = a;
+    const Connection *c_b = b;
+    if (c_a->distance != c_b->distance) return c_a->distance < c_b->distance ? -1 : 1;
+    if (c_a->a_idx != c_b->a_idx) return c_a->a_idx < c_b->a_idx ? -1 : 1;
+    if (c_a->b_idx != c_b->b_idx) return c_a->b_idx < c_b->b_idx ? -1 : 1;
     return 0;
 }
 
-int main(int argv, char* argc[])
+static void circuits_init(Circuits *c, size_t boxes_cnt)
 {
-    if (argv != 2) {
-        printf("no input file specified!\n");
-        return -1;
+    c->parent = malloc(boxes_cnt * sizeof(size_t));
+    c->size = malloc(boxes_cnt * sizeof(size_t));
+    c->count = boxes_cnt;
+    for (size_t i = 0; i < boxes_cnt; ++i) {
+        c->parent[i] = i;
+        c->size[i] = 1;
     }
+}
 
-    FILE *f = fopen(argc[1], "r");
-    if (!f) {
-        printf("can't open file %s\n", argc[1]);
-        return -1;
+static void circuits_free(Circuits *c)
+{
+    free(c->parent);
+    free(c->size);
+}
+
+static size_t circuits_find(Circuits *c, size_t box_idx)
+{
+    size_t root = box_idx;
+    while (c->parent[root] != root) {
+        root = c->parent[root];
+    }
+    // path compression
+    while (c->parent[box_idx] != root) {
+        size_t next = c->parent[box_idx];
+        c->parent[box_idx] = root;
+        box_idx = next;
     }
+    return root;
+}
 
-    JunctionBox p;
-    JunctionBoxArray boxes = {0};
+// false if boxes are already in the same circuit
+static bool circuits_union(Circuits *c, size_t a_idx, size_t b_idx)
+{
+    size_t a = circuits_find(c, a_idx);
+    size_t b = circuits_find(c, b_idx);
+    if (a == b) {
+        return false;
+    }
+    // smaller circuit goes under the bigger one
+    if (c->size[a] < c->size[b]) {
+        size_t tmp = a;
+        a = b;
+        b = tmp;
+    }
+    c->parent[b] = a;
+    c->size[a] += c->size[b];
+    --c->count;
+    return true;
+}
 
-    size_t circuit_id = 0;
-    while (read_point(&p, f)) {
-        p.circuit_id = circuit_id++;
-        DARRAY_PUSH(boxes, p);
+// product of the three largest circuit sizes
+static size_t top3_product(const Circuits *c, size_t boxes_cnt)
+{
+    size_t top[3] = {0};
+    for (size_t i = 0; i < boxes_cnt; ++i) {
+        if (c->parent[i] != i) {
+            continue;
+        }
+        size_t size = c->size[i];
+        for (size_t t = 0; t < 3; ++t) {
+            if (size > top[t]) {
+                size_t tmp = top[t];
+                top[t] = size;
+                size = tmp;
+            }
+        }
     }
+    return top[0] * top[1] * top[2];
+}
 
-    IdxPairs pairs = {0};
+// connect pairs shortest first (kruskal). answer 1 is taken after the first
+// max_connections pairs, answer 2 is the pair that makes a single circuit
+static void connect_sorted(const JunctionBoxes *boxes, const Connection *connections, size_t connections_cnt, size_t max_connections)
+{
+    const size_t boxes_cnt = boxes->x.length;
     size_t answer1 = 0, answer2 = 0;
 
-    size_t max_connections = 1000; // 10 for test 1000 for full
-
-    while(true) {
-        double min_distance = INFINITY;
-        size_t point_a, point_b;
-
-        for (size_t point_a_idx = 0; point_a_idx < boxes.length - 1; ++point_a_idx) {
-            double iter_min_dist = INFINITY;
-            size_t min_distance_idx = point_a_idx+1;
-            for (size_t point_b_idx = point_a_idx+1; point_b_idx < boxes.length; ++point_b_idx) {
-                double distance = point_distance(boxes.data[point_a_idx], boxes.data[point_b_idx]);
-                if (distance < iter_min_dist) {
-                    // optimization: only answer1 requires to check that 2 boxes in circuit are connected before
-                    // for answer 2 we only need to know if box already in circuit or not
-                    bool t = (answer1 == 0) ?
-                        !contains_index_pair(&pairs, point_a_idx, point_b_idx) :
-                        boxes.data[point_a_idx].circuit_id != boxes.data[point_b_idx].circuit_id;
-
-                    if (t) {
-                        iter_min_dist = distance;
-                        min_distance_idx = point_b_idx;
-                    }
-                }
+    Circuits circuits;
+    circuits_init(&circuits, boxes_cnt);
+    if (max_connections == 0) {
+        answer1 = top3_product(&circuits, boxes_cnt); // every box is its own circuit
+    }
+
+    for (size_t i = 0; i < connections_cnt; ++i) {
+        const Connection *c = &connections[i];
+        if (circuits_union(&circuits, c->a_idx, c->b_idx) && circuits.count == 1) {
+            answer2 = (size_t)boxes->x.data[c->a_idx] * boxes->x.data[c->b_idx];
+        }
+        // answer 1
+        if (i + 1 == max_connections) {
+            answer1 = top3_product(&circuits, boxes_cnt);
+        }
+        if (circuits.count == 1 && i + 1 >= max_connections) {
+            break;
+        }
+    }
+    if (connections_cnt < max_connections) {
+        answer1 = top3_product(&circuits, boxes_cnt);
+    }
+
+    printf("answer 1: %zu\n", answer1);
+    printf("answer 2: %zu\n", answer2);
+
+    circuits_free(&circuits);
+}
+
+// rows are stored at their place in the whole pairs list
+static void *fill_connections_chunk(void *arg)
+{
+    ConnectionsChunk *chunk = arg;
+    fill_connections(chunk->boxes, chunk->a_begin, chunk->a_end, chunk->connections);
+    return NULL;
+}
+
+static void *radix_count_chunk(void *arg)
+{
+    RadixChunk *chunk = arg;
+    memset(chunk->counts, 0, sizeof(chunk->counts));
+    for (size_t i = chunk->begin; i < chunk->end; ++i) {
+        ++chunk->counts[(chunk->src[i].distance >> chunk->shift) & (RADIX_BUCKETS - 1)];
+    }
+    return NULL;
+}
+
+static void *radix_scatter_chunk(void *arg)
+{
+    RadixChunk *chunk = arg;
+    for (size_t i = chunk->begin; i < chunk->end; ++i) {
+        size_t digit = (chunk->src[i].distance >> chunk->shift) & (RADIX_BUCKETS - 1);
+        chunk->dst[chunk->counts[digit]++] = chunk->src[i];
+    }
+    return NULL;
+}
+
+static void run_chunks(void *(*worker)(void *), RadixChunk *chunks, pthread_t *threads, size_t threads_cnt)
+{
+    for (size_t t = 0; t < threads_cnt; ++t) {
+        pthread_create(&threads[t], NULL, worker, &chunks[t]);
+    }
+    for (size_t t = 0; t < threads_cnt; ++t) {
+        pthread_join(threads[t], NULL);
+    }
+}
+
+/*
+    stable LSD radix sort by distance, RADIX_BITS per pass. every thread counts
+    digits of its range, output offsets go digit by digit and inside the digit
+    thread by thread, so pairs keep their (a, b) order whatever the threads
+    count is. passes where all pairs have the same digit are skipped.
+    returns data or tmp, whichever ends up sorted
+*/
+static Connection *radix_sort_connections(Connection *data, Connection *tmp, size_t cnt, size_t threads_cnt)
+{
+    RadixChunk *chunks = calloc(threads_cnt, sizeof(RadixChunk));
+    pthread_t *threads = malloc(threads_cnt * sizeof(pthread_t));
+
+    for (unsigned shift = 0; shift < 64; shift += RADIX_BITS) {
+        for (size_t t = 0; t < threads_cnt; ++t) {
+            chunks[t].src = data;
+            chunks[t].dst = tmp;
+            chunks[t].begin = cnt * t / threads_cnt;
+            chunks[t].end = cnt * (t + 1) / threads_cnt;
+            chunks[t].shift = shift;
+        }
+        run_chunks(radix_count_chunk, chunks, threads, threads_cnt);
+
+        size_t offset = 0;
+        bool single_digit = false;
+        for (size_t digit = 0; digit < RADIX_BUCKETS; ++digit) {
+            size_t digit_cnt = 0;
+            for (size_t t = 0; t < threads_cnt; ++t) {
+                size_t c = chunks[t].counts[digit];
+                chunks[t].counts[digit] = offset + digit_cnt;
+                digit_cnt += c;
+            }
+            single_digit |= digit_cnt == cnt;
+            offset += digit_cnt;
+        }
+        if (single_digit) {
+            continue;
+        }
+        run_chunks(radix_scatter_chunk, chunks, threads, threads_cnt);
+
+        Connection *swap = data;
+        data = tmp;
+        tmp = swap;
+    }
+
+    free(threads);
+    free(chunks);
+    return data;
+}
+
+// end of t-th of threads_cnt row blocks with about the same number of pairs
+static size_t rows_block_end(size_t boxes_cnt, size_t a_begin, size_t t, size_t threads_cnt)
+{
+    const size_t connections_cnt = boxes_cnt * (boxes_cnt - 1) / 2;
+    const size_t until = connections_cnt * (t + 1) / threads_cnt;
+    if (t == threads_cnt - 1) {
+        return boxes_cnt;
+    }
+    size_t a_end = a_begin;
+    while (a_end < boxes_cnt && connection_offset(boxes_cnt, a_end, a_end + 1) < until) {
+        ++a_end;
+    }
+    return a_end;
+}
+
+// all pairs in (distance, a, b) order. pairs are built in row blocks of
+// about the same size, one per thread, then radix sorted
+static Connection *sorted_connections(const JunctionBoxes *boxes, size_t threads_cnt)
+{
+    const size_t boxes_cnt = boxes->x.length;
+    const size_t connections_cnt = boxes_cnt * (boxes_cnt - 1) / 2;
+    Connection *connections = malloc(MAX(connections_cnt, 1) * sizeof(Connection));
+    Connection *tmp = malloc(MAX(connections_cnt, 1) * sizeof(Connection));
+
+    ConnectionsChunk *chunks = calloc(threads_cnt, sizeof(ConnectionsChunk));
+    pthread_t *threads = malloc(threads_cnt * sizeof(pthread_t));
+    size_t a_begin = 0;
+    for (size_t t = 0; t < threads_cnt; ++t) {
+        size_t a_end = rows_block_end(boxes_cnt, a_begin, t, threads_cnt);
+        chunks[t] = (ConnectionsChunk){
+            .boxes = boxes,
+            .a_begin = a_begin,
+            .a_end = a_end,
+            .connections = connections,
+        };
+        a_begin = a_end;
+        pthread_create(&threads[t], NULL, fill_connections_chunk, &chunks[t]);
+    }
+    for (size_t t = 0; t < threads_cnt; ++t) {
+        pthread_join(threads[t], NULL);
+    }
+
+    Connection *sorted = radix_sort_connections(connections, tmp, connections_cnt, threads_cnt);
+    free(sorted == connections ? tmp : connections);
+    free(threads);
+    free(chunks);
+    return sorted;
+}
+
+static void solve_parallel(const JunctionBoxes *boxes, size_t max_connections, size_t threads_cnt)
+{
+    const size_t boxes_cnt = boxes->x.length;
+    Connection *sorted = sorted_connections(boxes, threads_cnt);
+    connect_sorted(boxes, sorted, boxes_cnt * (boxes_cnt - 1) / 2, max_connections);
+    free(sorted);
+}
+
+/*
+    profile mode: answer 1 for every connections count in a single pass over
+    sorted pairs, written as csv: connections,top3_product,components.
+    rows go until the pair that makes a single circuit (answer 2), after it
+    nothing changes. answer 2 is printed after the csv, also when it goes to
+    stdout. circuit sizes are in a max heap with lazy deletion:
+    merged circuit pushes its new size, outdated entries are dropped when
+    they get on top
+*/
+static bool circuit_size_less(const CircuitSize *a, const CircuitSize *b)
+{
+    return a->size < b->size || (a->size == b->size && a->root < b->root);
+}
+
+static void sizes_push(CircuitSizes *heap, CircuitSize s)
+{
+    DARRAY_PUSH(*heap, s);
+    size_t i = heap->length - 1;
+    while (i && circuit_size_less(&heap->data[(i - 1) / 2], &s)) {
+        heap->data[i] = heap->data[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap->data[i] = s;
+}
+
+static CircuitSize sizes_pop(CircuitSizes *heap)
+{
+    CircuitSize top = heap->data[0];
+    CircuitSize s = heap->data[--heap->length];
+    size_t i = 0;
+    while (true) {
+        size_t child = 2 * i + 1;
+        if (child >= heap->length) {
+            break;
+        }
+        if (child + 1 < heap->length && circuit_size_less(&heap->data[child], &heap->data[child + 1])) {
+            ++child;
+        }
+        if (!circuit_size_less(&s, &heap->data[child])) {
+            break;
+        }
+        heap->data[i] = heap->data[child];
+        i = child;
+    }
+    if (heap->length) {
+        heap->data[i] = s;
+    }
+    return top;
+}
+
+// three largest circuits, outdated heap entries are dropped on the way
+static size_t sizes_top3_product(CircuitSizes *heap, const Circuits *circuits)
+{
+    CircuitSize top[3];
+    size_t top_cnt = 0;
+    while (top_cnt < 3 && heap->length) {
+        CircuitSize s = sizes_pop(heap);
+        if (circuits->parent[s.root] == s.root && circuits->size[s.root] == s.size) {
+            top[top_cnt++] = s;
+        }
+    }
+    size_t product = top_cnt == 3 ? top[0].size * top[1].size * top[2].size : 0;
+    for (size_t i = 0; i < top_cnt; ++i) {
+        sizes_push(heap, top[i]);
+    }
+    return product;
+}
+
+static void solve_profile(const JunctionBoxes *boxes, FILE *csv, size_t threads_cnt)
+{
+    const size_t boxes_cnt = boxes->x.length;
+    const size_t connections_cnt = boxes_cnt * (boxes_cnt - 1) / 2;
+    Connection *sorted = sorted_connections(boxes, threads_cnt);
+
+    Circuits circuits;
+    circuits_init(&circuits, boxes_cnt);
+    CircuitSizes heap = {0};
+    for (size_t i = 0; i < boxes_cnt; ++i) {
+        sizes_push(&heap, (CircuitSize){.size = 1, .root = i});
+    }
+
+    fprintf(csv, "connections,top3_product,components\n");
+    size_t product = sizes_top3_product(&heap, &circuits);
+    size_t answer2 = 0, merge_connections = 0;
+    for (size_t i = 0; i < connections_cnt && circuits.count > 1; ++i) {
+        const Connection *c = &sorted[i];
+        if (circuits_union(&circuits, c->a_idx, c->b_idx)) {
+            size_t root = circuits_find(&circuits, c->a_idx);
+            sizes_push(&heap, (CircuitSize){.size = circuits.size[root], .root = root});
+            product = sizes_top3_product(&heap, &circuits);
+            if (circuits.count == 1) {
+                answer2 = (size_t)boxes->x.data[c->a_idx] * boxes->x.data[c->b_idx];
+                merge_connections = i + 1;
+            }
+        }
+        fprintf(csv, "%zu,%zu,%zu\n", i + 1, product, circuits.count);
+    }
+
+    printf("single circuit after %zu connections\n", merge_connections);
+    printf("answer 2: %zu\n", answer2);
+
+    free(heap.data);
+    circuits_free(&circuits);
+    free(sorted);
+}
+
+/*
+    topk mode, memory is O(n + k) and nothing is sorted but k pairs:
+    - every thread streams pairs of its row block through a max heap of the
+      k shortest pairs, heaps are merged and sorted at the end
+    - answer 2 is the longest edge of the minimum spanning tree, grown by
+      prim's algorithm over the implicit complete graph
+*/
+static void topk_sift_down(Connection *heap, size_t heap_len, size_t i)
+{
+    Connection c = heap[i];
+    while (true) {
+        size_t child = 2 * i + 1;
+        if (child >= heap_len) {
+            break;
+        }
+        if (child + 1 < heap_len && compare_connections(&heap[child + 1], &heap[child]) > 0) {
+            ++child;
+        }
+        if (compare_connections(&heap[child], &c) <= 0) {
+            break;
+        }
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = c;
+}
+
+static void topk_offer(TopKChunk *chunk, const Connection *c)
+{
+    if (chunk->heap_len < chunk->k) {
+        size_t i = chunk->heap_len++;
+        while (i && compare_connections(c, &chunk->heap[(i - 1) / 2]) > 0) {
+            chunk->heap[i] = chunk->heap[(i - 1) / 2];
+            i = (i - 1) / 2;
+        }
+        chunk->heap[i] = *c;
+    } else if (compare_connections(c, &chunk->heap[0]) < 0) {
+        chunk->heap[0] = *c;
+        topk_sift_down(chunk->heap, chunk->heap_len, 0);
+    }
+}
+
+static void *topk_chunk(void *arg)
+{
+    TopKChunk *chunk = arg;
+    if (!chunk->k) {
+        return NULL; // nothing to keep, and the heap has no top to compare with
+    }
+    const size_t boxes_cnt = chunk->boxes->x.length;
+    Connection *row = malloc(MAX(boxes_cnt, 1) * sizeof(Connection));
+    for (size_t a_idx = chunk->a_begin; a_idx < chunk->a_end; ++a_idx) {
+        const size_t row_len = boxes_cnt - a_idx - 1;
+        distances_row(chunk->boxes, a_idx, a_idx + 1, boxes_cnt, row);
+        for (size_t i = 0; i < row_len; ++i) {
+            // most pairs are longer than anything in the full heap
+            if (chunk->heap_len == chunk->k && row[i].distance > chunk->heap[0].distance) {
+                continue;
+            }
+            topk_offer(chunk, &row[i]);
+        }
+    }
+    free(row);
+    return NULL;
+}
+
+// product of three largest circuits after connecting the k shortest pairs
+static size_t topk_product(const JunctionBoxes *boxes, size_t k, size_t threads_cnt)
+{
+    const size_t boxes_cnt = boxes->x.length;
+    TopKChunk *chunks = calloc(threads_cnt, sizeof(TopKChunk));
+    pthread_t *threads = malloc(threads_cnt * sizeof(pthread_t));
+    size_t a_begin = 0;
+    for (size_t t = 0; t < threads_cnt; ++t) {
+        size_t a_end = rows_block_end(boxes_cnt, a_begin, t, threads_cnt);
+        chunks[t] = (TopKChunk){
+            .boxes = boxes,
+            .a_begin = a_begin,
+            .a_end = a_end,
+            .k = k,
+            .heap = malloc(MAX(k, 1) * sizeof(Connection)),
+        };
+        a_begin = a_end;
+        pthread_create(&threads[t], NULL, topk_chunk, &chunks[t]);
+    }
+
+    Connection *shortest = malloc(MAX(k * threads_cnt, 1) * sizeof(Connection));
+    size_t shortest_cnt = 0;
+    for (size_t t = 0; t < threads_cnt; ++t) {
+        pthread_join(threads[t], NULL);
+        memcpy(shortest + shortest_cnt, chunks[t].heap, chunks[t].heap_len * sizeof(Connection));
+        shortest_cnt += chunks[t].heap_len;
+        free(chunks[t].heap);
+    }
+    qsort(shortest, shortest_cnt, sizeof(Connection), compare_connections);
+
+    Circuits circuits;
+    circuits_init(&circuits, boxes_cnt);
+    for (size_t i = 0; i < MIN(k, shortest_cnt); ++i) {
+        circuits_union(&circuits, shortest[i].a_idx, shortest[i].b_idx);
+    }
+    size_t product = top3_product(&circuits, boxes_cnt);
+
+    circuits_free(&circuits);
+    free(shortest);
+    free(threads);
+    free(chunks);
+    return product;
+}
+
+// longest edge of the minimum spanning tree, O(n^2) time and O(n) memory
+static Connection prim_last_edge(const JunctionBoxes *boxes)
+{
+    const size_t boxes_cnt = boxes->x.length;
+    Connection *nearest = malloc(boxes_cnt * sizeof(Connection)); // shortest pair to the tree
+    uint32_t *outside = malloc(boxes_cnt * sizeof(uint32_t));      // boxes not in the tree yet
+    size_t outside_cnt = 0;
+    for (size_t b_idx = 1; b_idx < boxes_cnt; ++b_idx) {
+        nearest[b_idx] = (Connection){.distance = box_distance(boxes, 0, b_idx), .a_idx = 0, .b_idx = b_idx};
+        outside[outside_cnt++] = b_idx;
+    }
+
+    Connection last = {0}; // before any pair, as b > a
+    while (outside_cnt) {
+        size_t best = 0;
+        for (size_t i = 1; i < outside_cnt; ++i) {
+            if (compare_connections(&nearest[outside[i]], &nearest[outside[best]]) < 0) {
+                best = i;
             }
-            if (iter_min_dist < min_distance) {
-                point_a = point_a_idx;
-                point_b = min_distance_idx;
-                min_distance = iter_min_dist;
+        }
+        const size_t added = outside[best];
+        if (compare_connections(&nearest[added], &last) > 0) {
+            last = nearest[added];
+        }
+        outside[best] = outside[--outside_cnt];
+
+        for (size_t i = 0; i < outside_cnt; ++i) {
+            const size_t b_idx = outside[i];
+            Connection c = {
+                .distance = box_distance(boxes, added, b_idx),
+                .a_idx = MIN(added, b_idx),
+                .b_idx = MAX(added, b_idx),
+            };
+            if (compare_connections(&c, &nearest[b_idx]) < 0) {
+                nearest[b_idx] = c;
             }
         }
-        if (min_distance < INFINITY) {
-            connect_boxes(&boxes, point_a, point_b);
-            // check if all in one circuit (this smells)
-            bool single_circuit = true;
-            for (size_t i = 1; i < boxes.length; ++i) {
-                if (boxes.data[i].circuit_id != boxes.data[0].circuit_id) {
-                    single_circuit = false;
+    }
+
+    free(outside);
+    free(nearest);
+    return last;
+}
+
+static void solve_topk(const JunctionBoxes *boxes, size_t max_connections, size_t threads_cnt)
+{
+    size_t answer1 = topk_product(boxes, max_connections, threads_cnt);
+    size_t answer2 = 0;
+    if (boxes->x.length > 1) {
+        Connection last = prim_last_edge(boxes);
+        answer2 = (size_t)boxes->x.data[last.a_idx] * boxes->x.data[last.b_idx];
+    }
+    printf("answer 1: %zu\n", answer1);
+    printf("answer 2: %zu\n", answer2);
+}
+
+/*
+    emst mode, memory stays O(n) for big inputs:
+    - k-d tree over boxes, nodes know the circuit if all boxes below are in one
+    - answer 2 is the longest edge of euclidean minimum spanning tree, built in
+      boruvka rounds: every box looks for the nearest box of another circuit
+      (in parallel), every circuit takes the shortest of them
+    - answer 1 enumerates pairs shortest first with a heap holding the next
+      pair of every box a, that is the next nearest box b > a
+    distances are squared, ties are broken by box indices as in kruskal
+*/
+#define KD_LEAF_SIZE 8
+#define NO_CIRCUIT SIZE_MAX
+
+typedef struct {
+    int32_t lo[3];
+    int32_t hi[3];
+    size_t begin;           // boxes range in tree order
+    size_t end;
+    size_t left;            // children, 0 for leaf (root is never a child)
+    size_t right;
+    size_t max_idx;         // max box index below
+    size_t circuit;         // circuit of all boxes below, or NO_CIRCUIT
+} KdNode;
+
+DARRAY_DEFINE_TYPE(KdNodeArray, KdNode);
+
+typedef struct {
+    KdNodeArray nodes;
+    size_t *order;          // box index in tree order
+    int32_t (*pos)[3];      // coordinates in tree order
+    size_t *circuit;        // circuit of box in tree order, for current round
+} KdTree;
+
+typedef struct {
+    const KdTree *tree;
+    size_t begin;           // tree order range
+    size_t end;
+    Connection *best;       // nearest foreign box, per tree position
+    uint64_t *bound;        // shortest distance found so far, per circuit
+} BoruvkaChunk;
+
+typedef struct {
+    const KdTree *tree;
+    size_t begin;           // box index range
+    size_t end;
+    Connection *next;       // first pair, per box
+} PairsChunk;
+
+static void select_nth(size_t *order, size_t begin, size_t end, size_t nth, int32_t (*pos)[3], int dim)
+{
+    while (end - begin > 1) {
+        int32_t pivot = pos[order[begin + (end - begin) / 2]][dim];
+        // three way partition: < pivot | == pivot | > pivot
+        size_t lt = begin, i = begin, gt = end;
+        while (i < gt) {
+            int32_t v = pos[order[i]][dim];
+            size_t tmp = order[i];
+            if (v < pivot) {
+                order[i++] = order[lt];
+                order[lt++] = tmp;
+            } else if (v > pivot) {
+                order[i] = order[--gt];
+                order[gt] = tmp;
+            } else {
+                ++i;
+            }
+        }
+        if (nth < lt) {
+            end = lt;
+        } else if (nth >= gt) {
+            begin = gt;
+        } else {
+            return;
+        }
+    }
+}
+
+// median split over the widest dimension, nodes are in preorder
+static size_t kdtree_build_node(KdTree *t, int32_t (*pos)[3], size_t begin, size_t end)
+{
+    KdNode node = {.begin = begin, .end = end, .circuit = NO_CIRCUIT};
+    for (int d = 0; d < 3; ++d) {
+        node.lo[d] = INT32_MAX;
+        node.hi[d] = INT32_MIN;
+    }
+    for (size_t i = begin; i < end; ++i) {
+        for (int d = 0; d < 3; ++d) {
+            node.lo[d] = MIN(node.lo[d], pos[t->order[i]][d]);
+            node.hi[d] = MAX(node.hi[d], pos[t->order[i]][d]);
+        }
+        node.max_idx = MAX(node.max_idx, t->order[i]);
+    }
+    size_t node_idx = t->nodes.length;
+    DARRAY_PUSH(t->nodes, node);
+    if (end - begin <= KD_LEAF_SIZE) {
+        return node_idx;
+    }
+    int dim = 0;
+    for (int d = 1; d < 3; ++d) {
+        if ((int64_t)node.hi[d] - node.lo[d] > (int64_t)node.hi[dim] - node.lo[dim]) {
+            dim = d;
+        }
+    }
+    size_t mid = begin + (end - begin) / 2;
+    select_nth(t->order, begin, end, mid, pos, dim);
+    size_t left = kdtree_build_node(t, pos, begin, mid);
+    size_t right = kdtree_build_node(t, pos, mid, end);
+    t->nodes.data[node_idx].left = left;
+    t->nodes.data[node_idx].right = right;
+    return node_idx;
+}
+
+static void kdtree_build(KdTree *t, const JunctionBoxes *boxes)
+{
+    const size_t n = boxes->x.length;
+    int32_t (*pos)[3] = malloc(n * sizeof(*pos));
+    t->nodes = (KdNodeArray){0};
+    t->order = malloc(n * sizeof(size_t));
+    t->pos = malloc(n * sizeof(*t->pos));
+    t->circuit = malloc(n * sizeof(size_t));
+    for (size_t i = 0; i < n; ++i) {
+        pos[i][0] = boxes->x.data[i];
+        pos[i][1] = boxes->y.data[i];
+        pos[i][2] = boxes->z.data[i];
+        t->order[i] = i;
+    }
+    kdtree_build_node(t, pos, 0, n);
+    for (size_t i = 0; i < n; ++i) {
+        memcpy(t->pos[i], pos[t->order[i]], sizeof(*pos));
+    }
+    free(pos);
+}
+
+static void kdtree_free(KdTree *t)
+{
+    free(t->nodes.data);
+    free(t->order);
+    free(t->pos);
+    free(t->circuit);
+}
+
+// label boxes and nodes with current circuits, children follow their parent
+static void kdtree_set_circuits(KdTree *t, Circuits *circuits)
+{
+    for (size_t i = 0; i < t->nodes.data[0].end; ++i) {
+        t->circuit[i] = circuits_find(circuits, t->order[i]);
+    }
+    for (size_t i = t->nodes.length; i-- > 0;) {
+        KdNode *node = &t->nodes.data[i];
+        if (node->left) {
+            size_t c = t->nodes.data[node->left].circuit;
+            node->circuit = c == t->nodes.data[node->right].circuit ? c : NO_CIRCUIT;
+        } else {
+            node->circuit = t->circuit[node->begin];
+            for (size_t k = node->begin + 1; k < node->end; ++k) {
+                if (t->circuit[k] != node->circuit) {
+                    node->circuit = NO_CIRCUIT;
                     break;
                 }
             }
-            if (single_circuit) {
-                answer2 = boxes.data[point_a].x * boxes.data[point_b].x;
-                break;
+        }
+    }
+}
+
+static uint64_t squared_distance(const int32_t a[3], const int32_t b[3])
+{
+    uint64_t result = 0;
+    for (int d = 0; d < 3; ++d) {
+        int64_t delta = (int64_t)a[d] - b[d];
+        result += (uint64_t)(delta * delta);
+    }
+    return result;
+}
+
+static uint64_t node_min_distance(const KdNode *node, const int32_t p[3])
+{
+    uint64_t result = 0;
+    for (int d = 0; d < 3; ++d) {
+        int64_t delta = MAX(MAX((int64_t)node->lo[d] - p[d], (int64_t)p[d] - node->hi[d]), 0);
+        result += (uint64_t)(delta * delta);
+    }
+    return result;
+}
+
+static uint64_t node_max_distance(const KdNode *node, const int32_t p[3])
+{
+    uint64_t result = 0;
+    for (int d = 0; d < 3; ++d) {
+        int64_t delta = MAX((int64_t)p[d] - node->lo[d], (int64_t)node->hi[d] - p[d]);
+        result += (uint64_t)(delta * delta);
+    }
+    return result;
+}
+
+static Connection make_connection(uint64_t distance, size_t a_idx, size_t b_idx)
+{
+    Connection c = {.distance = distance, .a_idx = MIN(a_idx, b_idx), .b_idx = MAX(a_idx, b_idx)};
+    return c;
+}
+
+// nearest box of another circuit than the box at tree position q,
+// node_distance is the distance to the node box, computed by the parent
+static void nearest_foreign(const KdTree *t, size_t node_idx, uint64_t node_distance, size_t q, Connection *best)
+{
+    const KdNode *node = &t->nodes.data[node_idx];
+    const int32_t *p = t->pos[q];
+    const size_t circuit = t->circuit[q];
+    if (node->circuit == circuit || node_distance > best->distance) {
+        return;
+    }
+    if (!node->left) {
+        for (size_t k = node->begin; k < node->end; ++k) {
+            if (t->circuit[k] == circuit) {
+                continue;
+            }
+            Connection c = make_connection(squared_distance(p, t->pos[k]), t->order[q], t->order[k]);
+            if (compare_connections(&c, best) < 0) {
+                *best = c;
             }
-            IdxPair p = {.a_idx = point_a, .b_idx = point_b};
-            DARRAY_PUSH(pairs, p);
         }
-        // answer 1
-        --max_connections;
-        if (max_connections == 0) {
-            CircuiInfoArray circuits = {0};
-            for (size_t p = 0; p < boxes.length; ++p) {
-                size_t circuit_id = boxes.data[p].circuit_id; // doesn matter a or b
-                bool found = false;
-                for (size_t i = 0; i < circuits.length; ++i) {
-                    if (circuits.data[i].circuit_id == circuit_id) {
-                        ++circuits.data[i].count;
-                        found = true;
-                        break;
-                    }
-                }
-                if (!found) {
-                    CircuiInfo c = {.circuit_id = circuit_id, .count = 1};
-                    DARRAY_PUSH(circuits, c);
-                }
+        return;
+    }
+    // closer child first, so the other one is more likely to be pruned
+    uint64_t left_distance = node_min_distance(&t->nodes.data[node->left], p);
+    uint64_t right_distance = node_min_distance(&t->nodes.data[node->right], p);
+    if (right_distance < left_distance) {
+        nearest_foreign(t, node->right, right_distance, q, best);
+        nearest_foreign(t, node->left, left_distance, q, best);
+    } else {
+        nearest_foreign(t, node->left, left_distance, q, best);
+        nearest_foreign(t, node->right, right_distance, q, best);
+    }
+}
+
+// next pair (a, b > a) of the box at tree position q, in (distance, b) order
+// after the given pair, or the first one if there is none
+static void next_pair(const KdTree *t, size_t node_idx, size_t q, const Connection *after, Connection *best)
+{
+    const KdNode *node = &t->nodes.data[node_idx];
+    const int32_t *p = t->pos[q];
+    const size_t a_idx = t->order[q];
+    if (node->max_idx <= a_idx ||
+        node_min_distance(node, p) > best->distance ||
+        (after && node_max_distance(node, p) < after->distance)) {
+        return;
+    }
+    if (!node->left) {
+        for (size_t k = node->begin; k < node->end; ++k) {
+            if (t->order[k] <= a_idx) {
+                continue;
+            }
+            Connection c = {.distance = squared_distance(p, t->pos[k]), .a_idx = a_idx, .b_idx = t->order[k]};
+            if ((!after || compare_connections(&c, after) > 0) && compare_connections(&c, best) < 0) {
+                *best = c;
             }
-            qsort(circuits.data, circuits.length, sizeof(CircuiInfo), compare_circuit_info);
-            answer1 = circuits.data[0].count * circuits.data[1].count * circuits.data[2].count;
-            free(circuits.data);
         }
+        return;
+    }
+    size_t first = node->left, second = node->right;
+    if (node_min_distance(&t->nodes.data[second], p) < node_min_distance(&t->nodes.data[first], p)) {
+        first = node->right;
+        second = node->left;
+    }
+    next_pair(t, first, q, after, best);
+    next_pair(t, second, q, after, best);
+}
+
+// only the shortest edge of the circuit matters, so search of every box is
+// bounded by what the other boxes of its circuit found (shared between threads)
+static void *nearest_foreign_chunk(void *arg)
+{
+    BoruvkaChunk *chunk = arg;
+    for (size_t q = chunk->begin; q < chunk->end; ++q) {
+        uint64_t *bound = &chunk->bound[chunk->tree->circuit[q]];
+        Connection best = {.distance = __atomic_load_n(bound, __ATOMIC_RELAXED), .a_idx = NO_BOX, .b_idx = NO_BOX};
+        nearest_foreign(chunk->tree, 0, node_min_distance(&chunk->tree->nodes.data[0], chunk->tree->pos[q]), q, &best);
+        chunk->best[q] = best;
+
+        uint64_t current = __atomic_load_n(bound, __ATOMIC_RELAXED);
+        while (best.distance < current &&
+               !__atomic_compare_exchange_n(bound, &current, best.distance, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        }
+    }
+    return NULL;
+}
+
+// longest edge of the minimum spanning tree
+static Connection boruvka_last_edge(KdTree *t, size_t boxes_cnt, size_t threads_cnt)
+{
+    Circuits circuits;
+    circuits_init(&circuits, boxes_cnt);
+    Connection *best = malloc(boxes_cnt * sizeof(Connection));
+    Connection *circuit_best = malloc(boxes_cnt * sizeof(Connection));
+    uint64_t *bound = malloc(boxes_cnt * sizeof(uint64_t));
+    BoruvkaChunk *chunks = calloc(threads_cnt, sizeof(BoruvkaChunk));
+    pthread_t *threads = malloc(threads_cnt * sizeof(pthread_t));
+    Connection last = {0}; // before any pair, as b > a
+
+    while (circuits.count > 1) {
+        kdtree_set_circuits(t, &circuits);
+        for (size_t q = 0; q < boxes_cnt; ++q) {
+            bound[t->circuit[q]] = NO_DISTANCE;
+        }
+        for (size_t th = 0; th < threads_cnt; ++th) {
+            chunks[th] = (BoruvkaChunk){
+                .tree = t,
+                .begin = boxes_cnt * th / threads_cnt,
+                .end = boxes_cnt * (th + 1) / threads_cnt,
+                .best = best,
+                .bound = bound,
+            };
+            pthread_create(&threads[th], NULL, nearest_foreign_chunk, &chunks[th]);
+        }
+        for (size_t th = 0; th < threads_cnt; ++th) {
+            pthread_join(threads[th], NULL);
+        }
+        // shortest edge out of every circuit, order is strict so there are no cycles
+        for (size_t q = 0; q < boxes_cnt; ++q) {
+            circuit_best[t->circuit[q]] = (Connection){.distance = NO_DISTANCE, .a_idx = NO_BOX, .b_idx = NO_BOX};
+        }
+        for (size_t q = 0; q < boxes_cnt; ++q) {
+            Connection *c = &circuit_best[t->circuit[q]];
+            if (compare_connections(&best[q], c) < 0) {
+                *c = best[q];
+            }
+        }
+        for (size_t q = 0; q < boxes_cnt; ++q) {
+            if (t->order[q] != t->circuit[q]) {
+                continue; // once per circuit, from its root box
+            }
+            const Connection *c = &circuit_best[t->circuit[q]];
+            if (circuits_union(&circuits, c->a_idx, c->b_idx) && compare_connections(c, &last) > 0) {
+                last = *c;
+            }
+        }
+    }
+
+    free(threads);
+    free(chunks);
+    free(bound);
+    free(circuit_best);
+    free(best);
+    circuits_free(&circuits);
+    return last;
+}
+
+static void *first_pairs_chunk(void *arg)
+{
+    PairsChunk *chunk = arg;
+    for (size_t q = chunk->begin; q < chunk->end; ++q) {
+        Connection best = {.distance = NO_DISTANCE, .a_idx = NO_BOX, .b_idx = NO_BOX};
+        next_pair(chunk->tree, 0, q, NULL, &best);
+        chunk->next[chunk->tree->order[q]] = best;
+    }
+    return NULL;
+}
+
+static void heap_push(Connection *heap, size_t *heap_len, Connection c)
+{
+    size_t i = (*heap_len)++;
+    while (i && compare_connections(&c, &heap[(i - 1) / 2]) < 0) {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap[i] = c;
+}
+
+static Connection heap_pop(Connection *heap, size_t *heap_len)
+{
+    Connection top = heap[0];
+    Connection c = heap[--*heap_len];
+    size_t i = 0;
+    while (true) {
+        size_t child = 2 * i + 1;
+        if (child >= *heap_len) {
+            break;
+        }
+        if (child + 1 < *heap_len && compare_connections(&heap[child + 1], &heap[child]) < 0) {
+            ++child;
+        }
+        if (compare_connections(&heap[child], &c) >= 0) {
+            break;
+        }
+        heap[i] = heap[child];
+        i = child;
+    }
+    if (*heap_len) {
+        heap[i] = c;
+    }
+    return top;
+}
+
+// connect first max_connections pairs, product of three largest circuits
+static size_t nearest_pairs_product(const KdTree *t, size_t boxes_cnt, size_t max_connections, size_t threads_cnt)
+{
+    Connection *heap = malloc(boxes_cnt * sizeof(Connection));
+    size_t heap_len = 0;
+    size_t *position = malloc(boxes_cnt * sizeof(size_t)); // tree position of box
+    for (size_t q = 0; q < boxes_cnt; ++q) {
+        position[t->order[q]] = q;
     }
 
+    PairsChunk *chunks = calloc(threads_cnt, sizeof(PairsChunk));
+    pthread_t *threads = malloc(threads_cnt * sizeof(pthread_t));
+    for (size_t th = 0; th < threads_cnt; ++th) {
+        chunks[th] = (PairsChunk){
+            .tree = t,
+            .begin = boxes_cnt * th / threads_cnt,
+            .end = boxes_cnt * (th + 1) / threads_cnt,
+            .next = heap,
+        };
+        pthread_create(&threads[th], NULL, first_pairs_chunk, &chunks[th]);
+    }
+    for (size_t th = 0; th < threads_cnt; ++th) {
+        pthread_join(threads[th], NULL);
+    }
+    // first pairs are stored by box index, heapify dropping boxes without pairs
+    for (size_t a = 0; a < boxes_cnt; ++a) {
+        if (heap[a].distance != NO_DISTANCE) {
+            heap_push(heap, &heap_len, heap[a]);
+        }
+    }
+
+    Circuits circuits;
+    circuits_init(&circuits, boxes_cnt);
+    for (size_t i = 0; i < max_connections && heap_len; ++i) {
+        Connection c = heap_pop(heap, &heap_len);
+        circuits_union(&circuits, c.a_idx, c.b_idx);
+        Connection next = {.distance = NO_DISTANCE, .a_idx = NO_BOX, .b_idx = NO_BOX};
+        next_pair(t, 0, position[c.a_idx], &c, &next);
+        if (next.distance != NO_DISTANCE) {
+            heap_push(heap, &heap_len, next);
+        }
+    }
+    size_t product = top3_product(&circuits, boxes_cnt);
+
+    circuits_free(&circuits);
+    free(threads);
+    free(chunks);
+    free(position);
+    free(heap);
+    return product;
+}
+
+static void solve_emst(const JunctionBoxes *boxes, size_t max_connections, size_t threads_cnt)
+{
+    const size_t boxes_cnt = boxes->x.length;
+    size_t answer1 = 0, answer2 = 0;
+    if (boxes_cnt > 1) {
+        KdTree tree;
+        kdtree_build(&tree, boxes);
+        answer1 = nearest_pairs_product(&tree, boxes_cnt, max_connections, threads_cnt);
+        Connection last = boruvka_last_edge(&tree, boxes_cnt, threads_cnt);
+        answer2 = (size_t)boxes->x.data[last.a_idx] * boxes->x.data[last.b_idx];
+        kdtree_free(&tree);
+    }
     printf("answer 1: %zu\n", answer1);
-    printf("answer 1: %zu\n", answer2);
+    printf("answer 2: %zu\n", answer2);
+}
+
+int main(int argv, char* argc[])
+{
+    if (argv < 2) {
+        printf("no input file specified!\n");
+        printf("usage: %s [emst|parallel|topk] <input> [connections] [threads]\n", argc[0]);
+        printf("       %s profile <input> <csv|-> [threads]\n", argc[0]);
+        return -1;
+    }
+
+    const char *mode = argv >= 3 &&
+        (strcmp(argc[1], "emst") == 0 || strcmp(argc[1], "parallel") == 0 ||
+         strcmp(argc[1], "topk") == 0 || strcmp(argc[1], "profile") == 0) ? argc[1] : NULL;
+    const int file_arg = mode ? 2 : 1;
+    const char *file_name = argc[file_arg];
+    const bool profile = mode && strcmp(mode, "profile") == 0;
+    if (profile && argv < 4) {
+        printf("no csv output specified!\n");
+        return -1;
+    }
+    long max_connections = argv > file_arg + 1 && !profile ? atol(argc[file_arg + 1]) : DEFAULT_CONNECTIONS;
+    long threads_cnt = argv > file_arg + 2 ? atol(argc[file_arg + 2]) : sysconf(_SC_NPROCESSORS_ONLN);
+    if (max_connections < 0) {
+        printf("wrong connections count %ld\n", max_connections);
+        return -1;
+    }
+    if (threads_cnt <= 0) {
+        threads_cnt = 1;
+    }
+
+    FILE *f = fopen(file_name, "r");
+    if (!f) {
+        printf("can't open file %s\n", file_name);
+        return -1;
+    }
+
+    int32_t p[3];
+    JunctionBoxes boxes = {0};
+
+    while (read_point(p, f)) {
+        DARRAY_PUSH(boxes.x, p[0]);
+        DARRAY_PUSH(boxes.y, p[1]);
+        DARRAY_PUSH(boxes.z, p[2]);
+    }
+
+    if (mode) {
+        if (profile) {
+            const char *csv_name = argc[file_arg + 1];
+            FILE *csv = strcmp(csv_name, "-") == 0 ? stdout : fopen(csv_name, "w");
+            if (csv) {
+                solve_profile(&boxes, csv, threads_cnt);
+                if (csv != stdout) {
+                    fclose(csv);
+                }
+            } else {
+                printf("can't open file %s\n", csv_name);
+            }
+        } else if (strcmp(mode, "emst") == 0) {
+            solve_emst(&boxes, max_connections, threads_cnt);
+        } else if (strcmp(mode, "parallel") == 0) {
+            solve_parallel(&boxes, max_connections, threads_cnt);
+        } else {
+            solve_topk(&boxes, max_connections, threads_cnt);
+        }
+        free(boxes.x.data);
+        free(boxes.y.data);
+        free(boxes.z.data);
+        fclose(f);
+        return 0;
+    }
+
+    // distances are computed once for every pair and sorted
+    const size_t boxes_cnt = boxes.x.length;
+    const size_t connections_cnt = boxes_cnt * (boxes_cnt - 1) / 2;
+    Connection *connections = malloc(MAX(connections_cnt, 1) * sizeof(Connection));
+    fill_connections(&boxes, 0, boxes_cnt, connections);
+    qsort(connections, connections_cnt, sizeof(Connection), compare_connections);
+    connect_sorted(&boxes, connections, connections_cnt, max_connections);
+
+    free(connections);
+    free(boxes.x.data);
+    free(boxes.y.data);
+    free(boxes.z.data);
 
-    free(boxes.data);
-    free(pairs.data);
-    
     fclose(f);
     return 0;
 }
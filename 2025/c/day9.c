@@ -5,6 +5,8 @@
 #include <stdint.h>
 #include <inttypes.h>
 #include <string.h>
+#include <pthread.h>
+#include <unistd.h>
 
 #include "common.h"
 
@@ -15,6 +17,64 @@ typedef struct {
 
 DARRAY_DEFINE_TYPE(Point2DArray, Point2D);
 
+/*
+    compressed tiles grid: odd cells 2i+1 are the distinct vertex coordinates,
+    even cells are the gaps between them (0 and last are the area around).
+    polygon edges are drawn on the grid, everything reachable from the area
+    around without crossing them is outside. rectangle is inside the polygon
+    if it covers no outside cell with tiles in it: O(1) with 2d prefix sums
+*/
+enum {
+    CELL_EMPTY = 0,
+    CELL_EDGE,
+    CELL_OUTSIDE,
+};
+
+typedef struct {
+    size_t *xs;             // distinct sorted coordinates
+    size_t xs_cnt;
+    size_t *ys;
+    size_t ys_cnt;
+    size_t width;           // grid size, 2 * cnt + 1
+    size_t height;
+    size_t *tile_cx;        // grid cell of every tile
+    size_t *tile_cy;
+    uint32_t *outside;      // prefix sums of outside cells with tiles, (width + 1) * (height + 1)
+} TileGrid;
+
+typedef struct {
+    size_t x1;
+    size_t x2;
+} Segment;
+
+// rectangle spanned by tiles a < b
+typedef struct {
+    uint64_t square;
+    uint32_t a_idx;
+    uint32_t b_idx;
+} Candidate;
+
+#define CANDIDATES_BATCH 64
+#define RADIX_BITS 8
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+
+/*
+    polygon index for point inside tests along rows. point is inside if it is
+    on the edge, or number of vertical edges to the right of it is odd. only
+    vertical edges with y_top < y <= y_bottom are counted, so a row between
+    two vertex ys always crosses the same edges: these are slabs with sorted
+    edge xs. vertices are on horizontal edges, so rows through them also check
+    horizontal edges at that y, sorted by x
+*/
+typedef struct {
+    size_t *ys;             // distinct vertex ys, sorted
+    size_t ys_cnt;
+    size_t *slab_begin;     // crossings of slab (ys[j-1], ys[j]] are [slab_begin[j], slab_begin[j+1])
+    size_t *crossings;      // x of vertical edges
+    size_t *edges_begin;    // horizontal edges at ys[j] are [edges_begin[j], edges_begin[j+1])
+    Segment *edges;
+} PolyIndex;
+
 static bool read_point2d(Point2D *p, FILE *f) {
     size_t coord[2] = {0};
     size_t coord_idx = 0;
@@ -33,55 +93,527 @@ static bool read_point2d(Point2D *p, FILE *f) {
     return true;
 }
 
-static bool point_inside_poly(Point2DArray points, Point2D p)
+static int compare_size(const void *a, const void *b)
+{
+    size_t v_a = *(const size_t *)a;
+    size_t v_b = *(const size_t *)b;
+    return (v_a > v_b) - (v_a < v_b);
+}
+
+// sorted distinct values, count is returned
+static size_t compress(size_t *values, size_t cnt)
+{
+    qsort(values, cnt, sizeof(size_t), compare_size);
+    size_t unique = 0;
+    for (size_t i = 0; i < cnt; ++i) {
+        if (!unique || values[unique - 1] != values[i]) {
+            values[unique++] = values[i];
+        }
+    }
+    return unique;
+}
+
+static size_t grid_cell(const size_t *values, size_t cnt, size_t v)
+{
+    const size_t *found = bsearch(&v, values, cnt, sizeof(size_t), compare_size);
+    return 2 * (found - values) + 1;
+}
+
+// tiles in the grid column (row) along one axis
+static size_t cell_tiles(const size_t *values, size_t cnt, size_t cell)
+{
+    if (cell % 2 || cell == 0 || cell == 2 * cnt) {
+        return 1; // vertex coordinate, or area around (outside anyway)
+    }
+    return values[cell / 2] - values[cell / 2 - 1] - 1;
+}
+
+static void grid_build(TileGrid *g, Point2DArray tiles)
 {
-    // point is on the line segment. Or on the right side number of vertical line segments is even
-    size_t lines_on_right = 0;
-    for (size_t i = 0; i < points.length; ++i) {
-        Point2D p1 = points.data[i];
-        Point2D p2 = points.data[i+1 == points.length ? 0 : i+1];
+    const size_t n = tiles.length;
+    g->xs = malloc(n * sizeof(size_t));
+    g->ys = malloc(n * sizeof(size_t));
+    for (size_t i = 0; i < n; ++i) {
+        g->xs[i] = tiles.data[i].x;
+        g->ys[i] = tiles.data[i].y;
+    }
+    g->xs_cnt = compress(g->xs, n);
+    g->ys_cnt = compress(g->ys, n);
+    g->width = 2 * g->xs_cnt + 1;
+    g->height = 2 * g->ys_cnt + 1;
+
+    g->tile_cx = malloc(n * sizeof(size_t));
+    g->tile_cy = malloc(n * sizeof(size_t));
+    for (size_t i = 0; i < n; ++i) {
+        g->tile_cx[i] = grid_cell(g->xs, g->xs_cnt, tiles.data[i].x);
+        g->tile_cy[i] = grid_cell(g->ys, g->ys_cnt, tiles.data[i].y);
+    }
 
-        size_t x_left = MIN(p1.x, p2.x);
-        size_t x_right = MAX(p1.x, p2.x);
-        size_t y_top = MIN(p1.y, p2.y);
-        size_t y_bottom = MAX(p1.y, p2.y);
-        // point lays on horizontal line segment
-        if (y_top == y_bottom) {
-            if (y_top == p.y && p.x >= x_left && p.x <= x_right) {
-                return true;
+    uint8_t *cells = calloc(g->width * g->height, 1);
+    for (size_t i = 0; i < n; ++i) {
+        size_t j = i + 1 == n ? 0 : i + 1;
+        size_t x1 = MIN(g->tile_cx[i], g->tile_cx[j]), x2 = MAX(g->tile_cx[i], g->tile_cx[j]);
+        size_t y1 = MIN(g->tile_cy[i], g->tile_cy[j]), y2 = MAX(g->tile_cy[i], g->tile_cy[j]);
+        for (size_t y = y1; y <= y2; ++y) {
+            for (size_t x = x1; x <= x2; ++x) {
+                cells[y * g->width + x] = CELL_EDGE;
             }
-            continue;
         }
-        // else vertical line segment
-        // ignoing top starting points, because in some cases they produce false positives
-        if (!(p.y > y_top && p.y <= y_bottom)) {
+    }
+
+    // flood fill from the corner, it is always outside
+    size_t *queue = malloc(g->width * g->height * sizeof(size_t));
+    size_t queue_len = 0;
+    cells[0] = CELL_OUTSIDE;
+    queue[queue_len++] = 0;
+    while (queue_len) {
+        size_t cell = queue[--queue_len];
+        size_t x = cell % g->width, y = cell / g->width;
+        size_t next[4] = {
+            x > 0 ? cell - 1 : SIZE_MAX,
+            x + 1 < g->width ? cell + 1 : SIZE_MAX,
+            y > 0 ? cell - g->width : SIZE_MAX,
+            y + 1 < g->height ? cell + g->width : SIZE_MAX,
+        };
+        for (size_t i = 0; i < 4; ++i) {
+            if (next[i] != SIZE_MAX && cells[next[i]] == CELL_EMPTY) {
+                cells[next[i]] = CELL_OUTSIDE;
+                queue[queue_len++] = next[i];
+            }
+        }
+    }
+    free(queue);
+
+    // gaps of zero width are not tiles, so they can't make rectangle invalid
+    const size_t stride = g->width + 1;
+    g->outside = calloc(stride * (g->height + 1), sizeof(uint32_t));
+    for (size_t y = 0; y < g->height; ++y) {
+        size_t row_tiles = cell_tiles(g->ys, g->ys_cnt, y);
+        for (size_t x = 0; x < g->width; ++x) {
+            bool bad = cells[y * g->width + x] == CELL_OUTSIDE && row_tiles && cell_tiles(g->xs, g->xs_cnt, x);
+            g->outside[(y + 1) * stride + x + 1] =
+                bad + g->outside[y * stride + x + 1] + g->outside[(y + 1) * stride + x] - g->outside[y * stride + x];
+        }
+    }
+    free(cells);
+}
+
+static void grid_free(TileGrid *g)
+{
+    free(g->xs);
+    free(g->ys);
+    free(g->tile_cx);
+    free(g->tile_cy);
+    free(g->outside);
+}
+
+// rectangle with corners in tiles a and b
+static bool rect_inside_grid(const TileGrid *g, size_t a_idx, size_t b_idx)
+{
+    const size_t stride = g->width + 1;
+    size_t x1 = MIN(g->tile_cx[a_idx], g->tile_cx[b_idx]), x2 = MAX(g->tile_cx[a_idx], g->tile_cx[b_idx]) + 1;
+    size_t y1 = MIN(g->tile_cy[a_idx], g->tile_cy[b_idx]), y2 = MAX(g->tile_cy[a_idx], g->tile_cy[b_idx]) + 1;
+    uint32_t outside = g->outside[y2 * stride + x2] - g->outside[y1 * stride + x2] - g->outside[y2 * stride + x1] + g->outside[y1 * stride + x1];
+    return outside == 0;
+}
+
+// first index with values[i] >= v
+static size_t lower_bound(const size_t *values, size_t cnt, size_t v)
+{
+    size_t lo = 0, hi = cnt;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (values[mid] < v) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static int compare_segment(const void *a, const void *b)
+{
+    const Segment *s_a = a;
+    const Segment *s_b = b;
+    return (s_a->x1 > s_b->x1) - (s_a->x1 < s_b->x1);
+}
+
+// transposed tiles give the index for columns
+static void poly_index_build(PolyIndex *idx, Point2DArray tiles, bool transposed)
+{
+    const size_t n = tiles.length;
+    Point2D *points = malloc(n * sizeof(Point2D));
+    for (size_t i = 0; i < n; ++i) {
+        points[i] = transposed ? (Point2D){.x = tiles.data[i].y, .y = tiles.data[i].x} : tiles.data[i];
+    }
+    idx->ys = malloc(n * sizeof(size_t));
+    for (size_t i = 0; i < n; ++i) {
+        idx->ys[i] = points[i].y;
+    }
+    idx->ys_cnt = compress(idx->ys, n);
+    idx->slab_begin = calloc(idx->ys_cnt + 1, sizeof(size_t));
+    idx->edges_begin = calloc(idx->ys_cnt + 1, sizeof(size_t));
+
+    // count, prefix sums, then fill: the same walk over edges twice
+    for (int pass = 0; pass < 2; ++pass) {
+        for (size_t i = 0; i < n; ++i) {
+            Point2D p1 = points[i];
+            Point2D p2 = points[i + 1 == n ? 0 : i + 1];
+            size_t y_top = MIN(p1.y, p2.y), y_bottom = MAX(p1.y, p2.y);
+            size_t j_top = lower_bound(idx->ys, idx->ys_cnt, y_top);
+            if (y_top == y_bottom) {
+                if (pass) {
+                    idx->edges[idx->edges_begin[j_top]++] = (Segment){.x1 = MIN(p1.x, p2.x), .x2 = MAX(p1.x, p2.x)};
+                } else {
+                    ++idx->edges_begin[j_top];
+                }
+                continue;
+            }
+            size_t j_bottom = lower_bound(idx->ys, idx->ys_cnt, y_bottom);
+            for (size_t j = j_top + 1; j <= j_bottom; ++j) {
+                if (pass) {
+                    idx->crossings[idx->slab_begin[j]++] = p1.x;
+                } else {
+                    ++idx->slab_begin[j];
+                }
+            }
+        }
+        if (!pass) {
+            // exclusive prefix sums: range starts, total at the end
+            size_t slabs_total = 0, edges_total = 0;
+            for (size_t j = 0; j <= idx->ys_cnt; ++j) {
+                size_t c = j < idx->ys_cnt ? idx->slab_begin[j] : 0;
+                idx->slab_begin[j] = slabs_total;
+                slabs_total += c;
+                c = j < idx->ys_cnt ? idx->edges_begin[j] : 0;
+                idx->edges_begin[j] = edges_total;
+                edges_total += c;
+            }
+            idx->crossings = malloc(MAX(slabs_total, 1) * sizeof(size_t));
+            idx->edges = malloc(MAX(edges_total, 1) * sizeof(Segment));
+        }
+    }
+    // fill pass moved every start to the end of its range, shift them back
+    for (size_t j = idx->ys_cnt; j > 0; --j) {
+        idx->slab_begin[j] = idx->slab_begin[j - 1];
+        idx->edges_begin[j] = idx->edges_begin[j - 1];
+    }
+    idx->slab_begin[0] = idx->edges_begin[0] = 0;
+    for (size_t j = 0; j < idx->ys_cnt; ++j) {
+        qsort(idx->crossings + idx->slab_begin[j], idx->slab_begin[j + 1] - idx->slab_begin[j], sizeof(size_t), compare_size);
+        qsort(idx->edges + idx->edges_begin[j], idx->edges_begin[j + 1] - idx->edges_begin[j], sizeof(Segment), compare_segment);
+    }
+    free(points);
+}
+
+static void poly_index_free(PolyIndex *idx)
+{
+    free(idx->ys);
+    free(idx->slab_begin);
+    free(idx->crossings);
+    free(idx->edges_begin);
+    free(idx->edges);
+}
+
+// true if all points (x_begin..x_end, y) are inside, single walk over the slab
+static bool poly_row_inside(const PolyIndex *idx, size_t y, size_t x_begin, size_t x_end)
+{
+    const size_t j = lower_bound(idx->ys, idx->ys_cnt, y);
+    const size_t *crossings = NULL;
+    size_t crossings_cnt = 0;
+    if (j > 0 && j < idx->ys_cnt) {
+        crossings = idx->crossings + idx->slab_begin[j];
+        crossings_cnt = idx->slab_begin[j + 1] - idx->slab_begin[j];
+    }
+    const Segment *edges = NULL;
+    size_t edges_cnt = 0;
+    if (j < idx->ys_cnt && idx->ys[j] == y) {
+        edges = idx->edges + idx->edges_begin[j];
+        edges_cnt = idx->edges_begin[j + 1] - idx->edges_begin[j];
+    }
+
+    size_t c = lower_bound(crossings, crossings_cnt, x_begin); // first crossing >= x
+    size_t e = 0;                                               // first edge that may cover x
+    while (e < edges_cnt && edges[e].x2 < x_begin) {
+        ++e;
+    }
+    size_t x = x_begin;
+    while (x <= x_end) {
+        while (c < crossings_cnt && crossings[c] < x) {
+            ++c;
+        }
+        while (e < edges_cnt && edges[e].x2 < x) {
+            ++e;
+        }
+        if (e < edges_cnt && edges[e].x1 <= x) {
+            x = edges[e].x2 + 1; // on horizontal edge
+        } else if (c < crossings_cnt && crossings[c] == x) {
+            // on vertical edge, and up to the next one if it is inside between them
+            x = c + 1 < crossings_cnt && (crossings_cnt - c - 1) % 2 ? MAX(crossings[c + 1], x + 1) : x + 1;
+        } else if ((crossings_cnt - c) % 2) {
+            x = crossings[c]; // inside up to the next crossing
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool rect_inside_perimeter(const PolyIndex *rows, const PolyIndex *cols, Point2D top_left, Point2D bottom_right)
+{
+    return
+        poly_row_inside(rows, top_left.y, top_left.x, bottom_right.x) &&
+        poly_row_inside(rows, bottom_right.y, top_left.x, bottom_right.x) &&
+        poly_row_inside(cols, top_left.x, top_left.y, bottom_right.y) &&
+        poly_row_inside(cols, bottom_right.x, top_left.y, bottom_right.y);
+}
+
+/*
+    stable LSD radix sort by descending square, RADIX_BITS per pass. pairs are
+    generated in tiles order, so equal squares keep it and the first valid
+    candidate is the one the pairs scan would pick. passes where all
+    candidates have the same digit are skipped
+*/
+static Candidate *radix_sort_candidates(Candidate *data, Candidate *tmp, size_t cnt)
+{
+    for (unsigned shift = 0; shift < 64; shift += RADIX_BITS) {
+        size_t counts[RADIX_BUCKETS] = {0};
+        for (size_t i = 0; i < cnt; ++i) {
+            ++counts[(~data[i].square >> shift) & (RADIX_BUCKETS - 1)];
+        }
+        bool single_digit = false;
+        size_t offset = 0;
+        for (size_t digit = 0; digit < RADIX_BUCKETS; ++digit) {
+            size_t c = counts[digit];
+            single_digit |= c == cnt;
+            counts[digit] = offset;
+            offset += c;
+        }
+        if (single_digit) {
             continue;
         }
-        // point lays on vert line segment
-        if (x_left == p.x) {
-            return true;
+        for (size_t i = 0; i < cnt; ++i) {
+            tmp[counts[(~data[i].square >> shift) & (RADIX_BUCKETS - 1)]++] = data[i];
+        }
+        Candidate *t = data;
+        data = tmp;
+        tmp = t;
+    }
+    return data;
+}
+
+/*
+    candidates are validated in descending area order, so the first valid one
+    is the answer. threads take batches of candidates in order from a shared
+    counter and keep the lowest valid index found. batches past it are not
+    taken, and when threads are done every candidate before it is checked
+*/
+typedef struct {
+    Point2DArray tiles;
+    const TileGrid *grid;           // default mode
+    const PolyIndex *rows;          // perimeter mode
+    const PolyIndex *cols;
+    const Candidate *candidates;
+    size_t candidates_cnt;
+    size_t next;                    // first candidate not taken yet
+    size_t found;                   // first valid candidate, candidates_cnt if none yet
+} CandidatesSearch;
+
+static bool candidate_inside(const CandidatesSearch *search, const Candidate *c)
+{
+    if (search->grid) {
+        return rect_inside_grid(search->grid, c->a_idx, c->b_idx);
+    }
+    Point2D a = search->tiles.data[c->a_idx], b = search->tiles.data[c->b_idx];
+    Point2D top_left = {.x = MIN(a.x, b.x), .y = MIN(a.y, b.y)};
+    Point2D bottom_right = {.x = MAX(a.x, b.x), .y = MAX(a.y, b.y)};
+    return rect_inside_perimeter(search->rows, search->cols, top_left, bottom_right);
+}
+
+static void *search_candidates(void *arg)
+{
+    CandidatesSearch *search = arg;
+    while (true) {
+        size_t begin = __atomic_fetch_add(&search->next, CANDIDATES_BATCH, __ATOMIC_RELAXED);
+        size_t end = MIN(begin + CANDIDATES_BATCH, search->candidates_cnt);
+        if (begin >= end) {
+            break;
+        }
+        for (size_t i = begin; i < end; ++i) {
+            size_t found = __atomic_load_n(&search->found, __ATOMIC_RELAXED);
+            if (i >= found) {
+                return NULL; // larger candidate is valid, the rest is smaller
+            }
+            if (candidate_inside(search, &search->candidates[i])) {
+                while (i < found && !__atomic_compare_exchange_n(&search->found, &found, i, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                }
+                break;
+            }
+        }
+    }
+    return NULL;
+}
+
+// all pairs in descending area order, for part 2 only:
+// O(n^2) memory, 16 bytes per pair and twice that while sorting
+static Candidate *sorted_candidates(Point2DArray tiles, size_t *candidates_cnt)
+{
+    const size_t n = tiles.length;
+    *candidates_cnt = n * (n - 1) / 2;
+    Candidate *candidates = malloc(*candidates_cnt * sizeof(Candidate));
+    Candidate *tmp = malloc(*candidates_cnt * sizeof(Candidate));
+    size_t c_idx = 0;
+    for (size_t a_idx = 0; a_idx + 1 < n; ++a_idx) {
+        for (size_t b_idx = a_idx + 1; b_idx < n; ++b_idx) {
+            Point2D a = tiles.data[a_idx], b = tiles.data[b_idx];
+            uint64_t width = MAX(a.x, b.x) - MIN(a.x, b.x) + 1;
+            uint64_t height = MAX(a.y, b.y) - MIN(a.y, b.y) + 1;
+            candidates[c_idx++] = (Candidate){.square = width * height, .a_idx = a_idx, .b_idx = b_idx};
+        }
+    }
+    Candidate *sorted = radix_sort_candidates(candidates, tmp, *candidates_cnt);
+    free(sorted == candidates ? tmp : candidates);
+    return sorted;
+}
+
+static int compare_point(const void *a, const void *b)
+{
+    const Point2D *p_a = a;
+    const Point2D *p_b = b;
+    if (p_a->x != p_b->x) return p_a->x < p_b->x ? -1 : 1;
+    if (p_a->y != p_b->y) return p_a->y < p_b->y ? -1 : 1;
+    return 0;
+}
+
+// negative if b is left or above of a, it is never the max then
+static int64_t corners_square(Point2D a, Point2D b)
+{
+    return ((int64_t)b.x - (int64_t)a.x + 1) * ((int64_t)b.y - (int64_t)a.y + 1);
+}
+
+/*
+    best bottom right corner for top left corners [lo, hi), searched in
+    [opt_lo, opt_hi]. both staircases go by x ascending and y descending, so
+    for a corner more to the right the best opposite corner is never more to
+    the left: take the middle corner, scan for its best, split the rest
+*/
+static int64_t staircases_max(const Point2D *top_left, size_t lo, size_t hi,
+    const Point2D *bottom_right, size_t opt_lo, size_t opt_hi)
+{
+    int64_t best = INT64_MIN;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        size_t opt = opt_lo;
+        int64_t mid_best = INT64_MIN;
+        for (size_t j = opt_lo; j <= opt_hi; ++j) {
+            int64_t square = corners_square(top_left[mid], bottom_right[j]);
+            if (square > mid_best) {
+                mid_best = square;
+                opt = j;
+            }
+        }
+        best = MAX(best, mid_best);
+        best = MAX(best, staircases_max(top_left, lo, mid, bottom_right, opt_lo, opt));
+        // right half in the loop, recursion depth stays log n
+        lo = mid + 1;
+        opt_lo = opt;
+    }
+    return best;
+}
+
+/*
+    largest rectangle with corners at top left and bottom right tiles, points
+    get sorted. top left corner with another tile to the left and above it can
+    be replaced by that tile for a larger rectangle, same for the bottom right
+    corner, so only the two staircases of extreme tiles are searched. no
+    bottom right extreme tile is left and above of a top left one, so invalid
+    pairs are never positive
+*/
+static int64_t max_square_staircases(Point2D *points, size_t cnt)
+{
+    qsort(points, cnt, sizeof(Point2D), compare_point);
+
+    Point2D *top_left = malloc(cnt * sizeof(Point2D));
+    Point2D *bottom_right = malloc(cnt * sizeof(Point2D));
+    size_t top_left_cnt = 0, bottom_right_cnt = 0;
+    for (size_t i = 0; i < cnt; ++i) {
+        if (!top_left_cnt || points[i].y < top_left[top_left_cnt - 1].y) {
+            top_left[top_left_cnt++] = points[i];
         }
-        // count vertical line segments to the right.
-        if (p.x < x_left) {
-            ++lines_on_right;
+    }
+    for (size_t i = cnt; i-- > 0;) {
+        if (!bottom_right_cnt || points[i].y > bottom_right[bottom_right_cnt - 1].y) {
+            bottom_right[bottom_right_cnt++] = points[i];
         }
     }
-    if (lines_on_right % 2 != 0) {
-        return true;
+    for (size_t i = 0; i < bottom_right_cnt / 2; ++i) {
+        Point2D t = bottom_right[i];
+        bottom_right[i] = bottom_right[bottom_right_cnt - 1 - i];
+        bottom_right[bottom_right_cnt - 1 - i] = t;
     }
-    return false;
+
+    int64_t best = staircases_max(top_left, 0, top_left_cnt, bottom_right, 0, bottom_right_cnt - 1);
+    free(top_left);
+    free(bottom_right);
+    return best;
+}
+
+// part 1 in O(n log n): top left - bottom right pairs, then flipped upside down for the other diagonal
+static uint64_t max_square(Point2DArray tiles)
+{
+    Point2D *points = malloc(DARRAY_BYTE_SIZE(tiles));
+    memcpy(points, tiles.data, DARRAY_BYTE_SIZE(tiles));
+    int64_t best = max_square_staircases(points, tiles.length);
+
+    size_t max_y = 0;
+    for (size_t i = 0; i < tiles.length; ++i) {
+        max_y = MAX(max_y, points[i].y);
+    }
+    for (size_t i = 0; i < tiles.length; ++i) {
+        points[i].y = max_y - points[i].y;
+    }
+    best = MAX(best, max_square_staircases(points, tiles.length));
+    free(points);
+    return best;
+}
+
+static void print_usage(const char *name)
+{
+    printf("usage: %s [perimeter] <input> [threads]\n", name);
+    printf("       %s staircase <input>\n", name);
+    printf("part 2 keeps all pairs of n tiles, 16 * n^2 bytes of memory at peak.\n");
+    printf("staircase mode is part 1 only, O(n) memory\n");
 }
 
 int main(int argv, char* argc[])
 {
-    if (argv != 2) {
+    if (argv < 2) {
         printf("no input file specified!\n");
+        print_usage(argc[0]);
         return -1;
     }
 
-    FILE *f = fopen(argc[1], "r");
+    // perimeter mode checks rows and columns of the rectangle perimeter
+    const bool perimeter = argv >= 3 && strcmp(argc[1], "perimeter") == 0;
+    // staircase mode is part 1 only, for large inputs where pairs don't fit
+    const bool staircase = argv >= 3 && strcmp(argc[1], "staircase") == 0;
+    const int file_arg = perimeter || staircase ? 2 : 1;
+    const char *file_name = argc[file_arg];
+    // staircase mode is single threaded, others take threads after the input
+    const int max_args = staircase ? file_arg + 1 : file_arg + 2;
+    if (argv > max_args) {
+        printf("too many arguments\n");
+        print_usage(argc[0]);
+        return -1;
+    }
+    long threads_cnt = argv > file_arg + 1 ? atol(argc[file_arg + 1]) : sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads_cnt <= 0) {
+        threads_cnt = 1;
+    }
+    FILE *f = fopen(file_name, "r");
     if (!f) {
-        printf("can't open file %s\n", argc[1]);
+        printf("can't open file %s\n", file_name);
         return -1;
     }
 
@@ -92,74 +624,83 @@ int main(int argv, char* argc[])
         DARRAY_PUSH(tiles, p);
     }
 
-    Point2D pm1 = {0}, pm2 = {0}; // for reporting only
+    if (tiles.length < 2) {
+        printf("not enough tiles\n");
+        free(tiles.data);
+        fclose(f);
+        return -1;
+    }
 
-    int64_t max1_square = 0, max2_square = 0;
-    for (size_t a_idx = 0; a_idx < tiles.length - 1; ++a_idx) {
-        for (size_t b_idx = a_idx + 1; b_idx < tiles.length; ++b_idx) {
-            int dx = tiles.data[a_idx].x - tiles.data[b_idx].x;
-            int dy = tiles.data[a_idx].y - tiles.data[b_idx].y;
-            int64_t width = ABS(dx) + 1;
-            int64_t height = ABS(dy) + 1;
-
-            int64_t square = width * height;
-
-            if (square > max2_square) {
-                Point2D top_left = {
-                    .x = MIN(tiles.data[a_idx].x, tiles.data[b_idx].x),
-                    .y = MIN(tiles.data[a_idx].y, tiles.data[b_idx].y)
-                };
-                Point2D bottom_right = {
-                    .x = MAX(tiles.data[a_idx].x, tiles.data[b_idx].x),
-                    .y = MAX(tiles.data[a_idx].y, tiles.data[b_idx].y)
-                };
-
-                // check corners first, this could speedup search
-                bool rect_inside =
-                    point_inside_poly(tiles, (Point2D){ .x = top_left.x, .y = top_left.y }) &&
-                    point_inside_poly(tiles, (Point2D){ .x = top_left.x, .y = bottom_right.y }) &&
-                    point_inside_poly(tiles, (Point2D){ .x = bottom_right.x, .y = bottom_right.y }) &&
-                    point_inside_poly(tiles, (Point2D){ .x = bottom_right.x, .y = top_left.y });
-
-                if (rect_inside) {
-                    // for each point on perimeter of rectabgle, check if point inside of the shape
-                    for (size_t x = top_left.x; x < (top_left.x + width) && rect_inside; ++x) {
-                        if (!point_inside_poly(tiles, (Point2D){ .x = x, .y = top_left.y }) ||
-                            !point_inside_poly(tiles, (Point2D){ .x = x, .y = top_left.y + height - 1 }))
-                        {
-                            rect_inside = false;
-                        }
-                    }
-                    for (size_t y = top_left.y; y < (top_left.y + height) && rect_inside; ++y) {
-                        if (!point_inside_poly(tiles, (Point2D){ .x = top_left.x, .y = y }) ||
-                            !point_inside_poly(tiles, (Point2D){ .x = top_left.x + width - 1, .y = y }))
-                        {
-                            rect_inside = false;
-                        }
-                    }
-                }
+    // part 1 in O(n log n), the candidates list is for part 2 only
+    const uint64_t max1_square = max_square(tiles);
+    if (staircase) {
+        printf("answer 1: %"PRIu64"\n", max1_square);
+        free(tiles.data);
+        fclose(f);
+        return 0;
+    }
 
-                if (rect_inside) {
-                    printf("new max square %"PRIu64" - (%zu,%zu) - (%zu,%zu)\n",
-                        square,
-                        tiles.data[a_idx].x, tiles.data[a_idx].y,
-                        tiles.data[b_idx].x, tiles.data[b_idx].y
-                    );
-                    pm1.x = tiles.data[a_idx].x;
-                    pm1.y = tiles.data[a_idx].y;
-                    pm2.x = tiles.data[b_idx].x;
-                    pm2.y = tiles.data[b_idx].y;
-
-                    max2_square = square;
-                }
-            }
-            max1_square = MAX(square, max1_square);
+    // part 2 takes tiles as polygon, its edges must follow rows or columns
+    for (size_t i = 0; i < tiles.length; ++i) {
+        Point2D p1 = tiles.data[i];
+        Point2D p2 = tiles.data[i + 1 == tiles.length ? 0 : i + 1];
+        if (p1.x != p2.x && p1.y != p2.y) {
+            printf("edge (%zu,%zu) - (%zu,%zu) is neither horizontal nor vertical\n", p1.x, p1.y, p2.x, p2.y);
+            free(tiles.data);
+            fclose(f);
+            return -1;
         }
     }
 
-    printf("answer 1: %"PRIi64"\n", max1_square);
-    printf("answer 2: %"PRIi64" (%zu,%zu) - (%zu,%zu)\n", max2_square, pm1.x, pm1.y, pm2.x, pm2.y);
+    TileGrid grid = {0};
+    PolyIndex rows = {0}, cols = {0};
+    if (perimeter) {
+        poly_index_build(&rows, tiles, false);
+        poly_index_build(&cols, tiles, true);
+    } else {
+        grid_build(&grid, tiles);
+    }
+
+    size_t candidates_cnt;
+    Candidate *candidates = sorted_candidates(tiles, &candidates_cnt);
+
+    CandidatesSearch search = {
+        .tiles = tiles,
+        .grid = perimeter ? NULL : &grid,
+        .rows = &rows,
+        .cols = &cols,
+        .candidates = candidates,
+        .candidates_cnt = candidates_cnt,
+        .found = candidates_cnt,
+    };
+    pthread_t *threads = malloc(threads_cnt * sizeof(pthread_t));
+    for (long t = 0; t < threads_cnt; ++t) {
+        pthread_create(&threads[t], NULL, search_candidates, &search);
+    }
+    for (long t = 0; t < threads_cnt; ++t) {
+        pthread_join(threads[t], NULL);
+    }
+    free(threads);
 
+    Point2D pm1 = {0}, pm2 = {0}; // for reporting only
+    uint64_t max2_square = 0;
+    if (search.found < candidates_cnt) {
+        const Candidate *c = &candidates[search.found];
+        pm1 = tiles.data[c->a_idx];
+        pm2 = tiles.data[c->b_idx];
+        max2_square = c->square;
+    }
+
+    printf("answer 1: %"PRIu64"\n", max1_square);
+    printf("answer 2: %"PRIu64" (%zu,%zu) - (%zu,%zu)\n", max2_square, pm1.x, pm1.y, pm2.x, pm2.y);
+
+    free(candidates);
+    if (perimeter) {
+        poly_index_free(&rows);
+        poly_index_free(&cols);
+    } else {
+        grid_free(&grid);
+    }
     free(tiles.data);
     fclose(f);
     return 0;